@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Compares stamping with the 32 pixel brush against stamping it the way
+ * Painter did before brushes were turned into coverage masks, reading
+ * every texel of the brush image with getPixel. Dots are timed on their
+ * own and along strokes. Run with the directory holding the brush
+ * images ("Images") and, optionally, a number of strokes to draw.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "Painter.h"
+#include "TiledImage.h"
+#include "Util.h"
+
+using namespace std;
+
+const int BRUSH_SIZE = 32;
+const unsigned int CANVAS_WIDTH = 800;
+const unsigned int CANVAS_HEIGHT = 450;
+const unsigned int STROKE_POINTS = 16;
+
+/*
+ * Stamps a brush one texel at a time, as drawDot used to.
+ */
+static void
+referenceDot(Image *image, const Image *brush, unsigned int x, unsigned int y, const Color &color)
+{
+	unsigned int brushWidth = brush->getWidth();
+	unsigned int brushHeight = brush->getHeight();
+
+	x -= brushWidth / 2;
+	y -= brushHeight / 2;
+
+	for(unsigned int i = 0; i < brushHeight; ++i) {
+		unsigned int destY = y + i;
+		if(destY >= image->getHeight())
+			continue;
+
+		for(unsigned int j = 0; j < brushWidth; ++j) {
+			unsigned int destX = x + j;
+			if(destX >= image->getWidth())
+				continue;
+
+			if(brush->getPixel(j, i).a != 0)
+				image->setPixel(destX, destY, color);
+		}
+	}
+}
+
+/*
+ * Stamps a brush at every pixel along a line, as drawLine used to.
+ */
+static void
+referenceLine(Image *image, const Image *brush, int x1, int y1, int x2, int y2, const Color &color)
+{
+	int steps = abs(x2 - x1) > abs(y2 - y1) ? abs(x2 - x1) : abs(y2 - y1);
+	if(steps == 0) {
+		referenceDot(image, brush, (unsigned int)x1, (unsigned int)y1, color);
+		return;
+	}
+
+	for(int i = 0; i <= steps; ++i) {
+		float t = (float)i / steps;
+		referenceDot(image, brush, (unsigned int)(x1 + (x2 - x1) * t), (unsigned int)(y1 + (y2 - y1) * t), color);
+	}
+}
+
+/*
+ * Makes strokes that wander the way hand-drawn ones do.
+ */
+static void
+makeStrokes(unsigned int strokes, vector <int16_t> &points)
+{
+	for(unsigned int i = 0; i < strokes; ++i) {
+		int x = rand() % CANVAS_WIDTH, y = rand() % CANVAS_HEIGHT;
+		for(unsigned int j = 0; j < STROKE_POINTS; ++j) {
+			points.push_back((int16_t)x);
+			points.push_back((int16_t)y);
+			x = abs(x + (rand() % 41) - 20) % CANVAS_WIDTH;
+			y = abs(y + (rand() % 41) - 20) % CANVAS_HEIGHT;
+		}
+	}
+}
+
+static void
+printResult(const char *name, unsigned long stamps, long referenceTime, long time)
+{
+	referenceTime = (referenceTime > 0) ? referenceTime : 1;
+	time = (time > 0) ? time : 1;
+	printf("%-8s %8lu stamps: per-texel %8.3f us/stamp | masks %8.3f us/stamp | %5.1fx\n",
+	       name, stamps, (double)referenceTime / stamps, (double)time / stamps,
+	       (double)referenceTime / time);
+}
+
+int
+main(int argc, char **argv)
+{
+	if(argc < 2) {
+		printf("usage: %s <directory holding Images> [strokes]\n", argv[0]);
+		return 1;
+	}
+	if(chdir(argv[1]) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	unsigned int strokes = (argc > 2) ? (unsigned int)atoi(argv[2]) : 2000;
+
+	Painter painter;
+	Image *brush = Image::load("Images/Brush32.png");
+	TiledImage referenceCanvas(CANVAS_WIDTH, CANVAS_HEIGHT, 3);
+	TiledImage canvas(CANVAS_WIDTH, CANVAS_HEIGHT, 3);
+	Color color((uint8_t)20, (uint8_t)40, (uint8_t)200);
+
+	srand(1);
+	vector <int16_t> points;
+	makeStrokes(strokes, points);
+	unsigned int dots = strokes * STROKE_POINTS;
+
+	// single dots, at each point of the strokes
+	long start = getMicroseconds();
+	for(unsigned int i = 0; i < dots; ++i)
+		referenceDot(&referenceCanvas, brush, points[i * 2], points[(i * 2) + 1], color);
+	long referenceTime = getMicroseconds() - start;
+
+	start = getMicroseconds();
+	for(unsigned int i = 0; i < dots; ++i)
+		painter.drawDot(&canvas, points[i * 2], points[(i * 2) + 1], color, BRUSH_SIZE);
+	long time = getMicroseconds() - start;
+	printResult("dots", dots, referenceTime, time);
+
+	// whole strokes, with a stamp at every pixel along them
+	unsigned long stamps = 0;
+	for(unsigned int i = 0; i < strokes; ++i) {
+		const int16_t *stroke = &points[i * STROKE_POINTS * 2];
+		for(unsigned int j = 0; j + 1 < STROKE_POINTS; ++j) {
+			int dx = abs(stroke[(j * 2) + 2] - stroke[j * 2]);
+			int dy = abs(stroke[(j * 2) + 3] - stroke[(j * 2) + 1]);
+			stamps += ((dx > dy) ? dx : dy) + 1;
+		}
+	}
+
+	start = getMicroseconds();
+	for(unsigned int i = 0; i < strokes; ++i) {
+		const int16_t *stroke = &points[i * STROKE_POINTS * 2];
+		for(unsigned int j = 0; j + 1 < STROKE_POINTS; ++j)
+			referenceLine(&referenceCanvas, brush, stroke[j * 2], stroke[(j * 2) + 1],
+			              stroke[(j * 2) + 2], stroke[(j * 2) + 3], color);
+	}
+	referenceTime = getMicroseconds() - start;
+
+	start = getMicroseconds();
+	for(unsigned int i = 0; i < strokes; ++i)
+		painter.drawPolyline(&canvas, &points[i * STROKE_POINTS * 2], STROKE_POINTS, color, BRUSH_SIZE);
+	time = getMicroseconds() - start;
+	printResult("strokes", stamps, referenceTime, time);
+
+	delete brush;
+	return 0;
+}
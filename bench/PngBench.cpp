@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Compares PngEncoder with libpng (Image::encodePng) on canvases of a
+ * few sizes: a full encode at the default settings, an encode after a
+ * small change, and a full encode at level 1 without filtering. Run
+ * with a thread count for the encoder and a number of rounds to take
+ * the best time of.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "PngEncoder.h"
+#include "TiledImage.h"
+#include "Util.h"
+
+using namespace std;
+
+/*
+ * Draws a rectangle of a pattern that compresses about as well as
+ * strokes do, and marks it dirty.
+ */
+static void
+drawPattern(Image *image, unsigned int left, unsigned int top,
+            unsigned int width, unsigned int height, int seed)
+{
+	for(unsigned int y = top; y < top + height && y < image->getHeight(); ++y) {
+		for(unsigned int x = left; x < left + width && x < image->getWidth(); ++x) {
+			uint8_t v = (uint8_t)((((x / 7) * seed) + (y / 5)) & 0xff);
+			image->setPixel(x, y, Color(v, (uint8_t)(v / 2), (uint8_t)(255 - v)));
+		}
+	}
+	image->markDirty(left, top, width, height);
+}
+
+static long
+timeLibpng(const Image *image, unsigned int rounds, size_t *length)
+{
+	long best = -1;
+	for(unsigned int i = 0; i < rounds; ++i) {
+		string png;
+		long start = getMicroseconds();
+		image->encodePng(png);
+		long time = getMicroseconds() - start;
+		if(best < 0 || time < best)
+			best = time;
+		*length = png.length();
+	}
+
+	return best;
+}
+
+/*
+ * Times full encodes by a fresh encoder each round, and encodes by the
+ * same encoder again after a small change to the canvas.
+ */
+static void
+timeEncoder(TiledImage *canvas, const PngEncoder::Settings &settings, unsigned int rounds,
+            long *fullTime, long *changedTime, size_t *length)
+{
+	*fullTime = -1;
+	*changedTime = -1;
+	for(unsigned int i = 0; i < rounds; ++i) {
+		PngEncoder encoder(settings);
+		string png;
+
+		Image *snapshot = canvas->snapshot();
+		long start = getMicroseconds();
+		encoder.encode(snapshot, png);
+		long time = getMicroseconds() - start;
+		delete snapshot;
+		if(*fullTime < 0 || time < *fullTime)
+			*fullTime = time;
+		*length = png.length();
+
+		drawPattern(canvas, canvas->getWidth() / 3, canvas->getHeight() / 2, 50, 20, 77 + i);
+		snapshot = canvas->snapshot();
+		start = getMicroseconds();
+		encoder.encode(snapshot, png);
+		time = getMicroseconds() - start;
+		delete snapshot;
+		if(*changedTime < 0 || time < *changedTime)
+			*changedTime = time;
+	}
+}
+
+static void
+benchSize(unsigned int width, unsigned int height, unsigned int threads, unsigned int rounds)
+{
+	// a white canvas with patches drawn here and there
+	TiledImage canvas(width, height, 3);
+	for(unsigned int y = 0; y < height; ++y) {
+		for(unsigned int x = 0; x < width; ++x)
+			canvas.setPixel(x, y, Color((uint8_t)255, (uint8_t)255, (uint8_t)255));
+	}
+	canvas.markDirty(0, 0, width, height);
+	for(unsigned int i = 0; i < 40; ++i)
+		drawPattern(&canvas, (i * 97) % width, (i * 53) % height, 120, 40, i + 1);
+
+	size_t libpngLength;
+	Image *snapshot = canvas.snapshot();
+	long libpngTime = timeLibpng(snapshot, rounds, &libpngLength);
+	delete snapshot;
+
+	PngEncoder::Settings settings;
+	settings.threads = threads;
+	long fullTime, changedTime;
+	size_t length;
+	timeEncoder(&canvas, settings, rounds, &fullTime, &changedTime, &length);
+
+	PngEncoder::Settings quickSettings;
+	quickSettings.level = 1;
+	quickSettings.filter = PngEncoder::FILTER_NONE;
+	quickSettings.threads = threads;
+	long quickTime, quickChangedTime;
+	size_t quickLength;
+	timeEncoder(&canvas, quickSettings, rounds, &quickTime, &quickChangedTime, &quickLength);
+
+	printf("%4ux%-4u libpng %4ld ms %8lu bytes | encoder %4ld ms %8lu bytes, changed %3ld ms | "
+	       "level 1, no filter %4ld ms %8lu bytes\n",
+	       width, height,
+	       libpngTime / 1000, (unsigned long)libpngLength,
+	       fullTime / 1000, (unsigned long)length, changedTime / 1000,
+	       quickTime / 1000, (unsigned long)quickLength);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int threads = (argc > 1) ? (unsigned int)atoi(argv[1]) : 1;
+	unsigned int rounds = (argc > 2) ? (unsigned int)atoi(argv[2]) : 3;
+	if(threads < 1)
+		threads = 1;
+	if(rounds < 1)
+		rounds = 1;
+
+	printf("%u encoder threads, best of %u\n", threads, rounds);
+	benchSize(800, 450, threads, rounds);
+	benchSize(1920, 1080, threads, rounds);
+	benchSize(3840, 2160, threads, rounds);
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures how quickly stroke payloads are parsed from the text form
+ * posted by clients and decoded from the binary form, for a few typical
+ * stroke shapes. Run with an iteration count to change the default.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "Stroke.h"
+#include "Util.h"
+
+using namespace std;
+
+/*
+ * Makes the text form of a stroke of the given number of connected
+ * segments, wandering the way a hand-drawn stroke does.
+ */
+static string
+makeStroke(unsigned int segments)
+{
+	string s;
+	int x = 400, y = 225;
+	char buf[64];
+
+	for(unsigned int i = 0; i < segments; ++i) {
+		int nextX = x + (rand() % 21) - 10;
+		int nextY = y + (rand() % 21) - 10;
+		nextX = (nextX < 0) ? 0 : (nextX > 799) ? 799 : nextX;
+		nextY = (nextY < 0) ? 0 : (nextY > 449) ? 449 : nextY;
+
+		snprintf(buf, sizeof(buf), "%s%d,%d,%d,%d", (i == 0) ? "" : ";", x, y, nextX, nextY);
+		s += buf;
+		x = nextX;
+		y = nextY;
+	}
+
+	return s;
+}
+
+static void
+benchStroke(unsigned int segments, unsigned int iterations)
+{
+	string text = makeStroke(segments);
+	Stroke stroke;
+	if(!stroke.parse(text)) {
+		printf("%u segments: the stroke didn't parse\n", segments);
+		exit(1);
+	}
+	string binary;
+	stroke.encode(binary);
+
+	unsigned long points = 0;
+	long start = getMicroseconds();
+	for(unsigned int i = 0; i < iterations; ++i) {
+		Stroke parsed;
+		parsed.parse(text);
+		points += parsed.getPointCount();
+	}
+	long parseTime = getMicroseconds() - start;
+
+	start = getMicroseconds();
+	for(unsigned int i = 0; i < iterations; ++i) {
+		Stroke decoded;
+		decoded.decode((const unsigned char *)binary.data(), (const unsigned char *)binary.data() + binary.length());
+		points += decoded.getPointCount();
+	}
+	long decodeTime = getMicroseconds() - start;
+
+	double parseSeconds = (parseTime > 0 ? parseTime : 1) / 1000000.0;
+	double decodeSeconds = (decodeTime > 0 ? decodeTime : 1) / 1000000.0;
+	printf("%5u segments: parse %8.0f strokes/s %7.1f MB/s | decode %8.0f strokes/s %7.1f MB/s (%lu points)\n",
+	       segments,
+	       iterations / parseSeconds, (double)text.length() * iterations / parseSeconds / 1000000.0,
+	       iterations / decodeSeconds, (double)binary.length() * iterations / decodeSeconds / 1000000.0,
+	       points);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int iterations = (argc > 1) ? (unsigned int)atoi(argv[1]) : 20000;
+
+	srand(1);
+	benchStroke(1, iterations * 10);
+	benchStroke(16, iterations);
+	benchStroke(128, iterations / 4);
+	benchStroke(1024, iterations / 32);
+
+	return 0;
+}
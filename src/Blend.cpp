@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Blend.h"
+
+#ifdef BLEND_HAVE_X86
+#include <immintrin.h>
+#endif
+
+static inline uint8_t
+blendByte(uint8_t dest, uint8_t source, uint8_t alpha)
+{
+	// exact rounded division by 255
+	unsigned int tmp = (unsigned int)source * alpha + (unsigned int)dest * (255 - alpha) + 128;
+	return (uint8_t)((tmp + (tmp >> 8)) >> 8);
+}
+
+void
+blendRowScalar(uint8_t *dest, const uint8_t *source, const uint8_t *alpha,
+               unsigned int length)
+{
+	for(unsigned int i = 0; i < length; ++i)
+		dest[i] = blendByte(dest[i], source[i], alpha[i]);
+}
+
+#ifdef BLEND_HAVE_X86
+__attribute__((target("sse2"))) static inline __m128i
+blend16SSE2(__m128i dest, __m128i source, __m128i alpha)
+{
+	// 16-bit lanes: source * alpha + dest * (255 - alpha) + 128
+	__m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+	__m128i tmp = _mm_add_epi16(_mm_mullo_epi16(source, alpha), _mm_mullo_epi16(dest, inverse));
+	tmp = _mm_add_epi16(tmp, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(tmp, _mm_srli_epi16(tmp, 8)), 8);
+}
+
+__attribute__((target("sse2"))) void
+blendRowSSE2(uint8_t *dest, const uint8_t *source, const uint8_t *alpha,
+             unsigned int length)
+{
+	__m128i zero = _mm_setzero_si128();
+
+	unsigned int i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+		__m128i s = _mm_loadu_si128((const __m128i *)(source + i));
+		__m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+
+		__m128i lo = blend16SSE2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero));
+		__m128i hi = blend16SSE2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero));
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+	}
+
+	blendRowScalar(dest + i, source + i, alpha + i, length - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+blend16AVX2(__m256i dest, __m256i source, __m256i alpha)
+{
+	__m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+	__m256i tmp = _mm256_add_epi16(_mm256_mullo_epi16(source, alpha), _mm256_mullo_epi16(dest, inverse));
+	tmp = _mm256_add_epi16(tmp, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(tmp, _mm256_srli_epi16(tmp, 8)), 8);
+}
+
+__attribute__((target("avx2"))) void
+blendRowAVX2(uint8_t *dest, const uint8_t *source, const uint8_t *alpha,
+             unsigned int length)
+{
+	__m256i zero = _mm256_setzero_si256();
+
+	// unpacking and packing both work within 128-bit lanes,
+	// so the bytes come back out in their original order
+	unsigned int i = 0;
+	for(; i + 32 <= length; i += 32) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dest + i));
+		__m256i s = _mm256_loadu_si256((const __m256i *)(source + i));
+		__m256i a = _mm256_loadu_si256((const __m256i *)(alpha + i));
+
+		__m256i lo = blend16AVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(a, zero));
+		__m256i hi = blend16AVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(a, zero));
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_packus_epi16(lo, hi));
+	}
+
+	blendRowSSE2(dest + i, source + i, alpha + i, length - i);
+}
+#endif /* BLEND_HAVE_X86 */
+
+BlendRowFunction
+getBlendRowFunction()
+{
+#ifdef BLEND_HAVE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return blendRowAVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return blendRowSSE2;
+#endif
+
+	return blendRowScalar;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BLEND_H__
+#define __BLEND_H__
+
+#include <stdint.h>
+
+/*
+ * Row compositing kernels. Each kernel blends length bytes of source
+ * over destination using a per-byte alpha, in integer arithmetic:
+ *
+ *   dest = (source * alpha + dest * (255 - alpha)) / 255
+ *
+ * with the division rounded to nearest. Passing color components as
+ * source and 255 for an alpha channel gives premultiplied source-over.
+ * All kernels produce bit-identical results.
+ */
+typedef void (*BlendRowFunction)(uint8_t *dest, const uint8_t *source, const uint8_t *alpha, unsigned int length);
+
+void blendRowScalar(uint8_t *dest, const uint8_t *source, const uint8_t *alpha, unsigned int length);
+
+#if defined(__i386__) || defined(__x86_64__)
+#define BLEND_HAVE_X86
+void blendRowSSE2(uint8_t *dest, const uint8_t *source, const uint8_t *alpha, unsigned int length);
+void blendRowAVX2(uint8_t *dest, const uint8_t *source, const uint8_t *alpha, unsigned int length);
+#endif
+
+/* returns the fastest kernel supported by the running CPU */
+BlendRowFunction getBlendRowFunction();
+
+#endif /* __BLEND_H__ */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Exception.h"
+#include "Brush.h"
+
+using namespace std;
+
+Brush::Brush(const Image *image)
+{
+	m_width = image->getWidth();
+	m_height = image->getHeight();
+	if(m_width == 0 || m_height == 0)
+		throw Exception("Brush::Brush(): Brush image is empty");
+
+	m_coverage = new uint8_t[m_width * m_height];
+	m_spanStart = new int[m_height];
+	m_spanEnd = new int[m_height];
+	m_fullStart = new int[m_height];
+	m_fullEnd = new int[m_height];
+
+	for(unsigned int y = 0; y < m_height; ++y) {
+		uint8_t *row = m_coverage + (m_width * y);
+
+		// rows without any coverage get an empty span (start > end)
+		m_spanStart[y] = (int)m_width;
+		m_spanEnd[y] = -1;
+		m_fullStart[y] = (int)m_width;
+		m_fullEnd[y] = -1;
+
+		int runStart = -1;
+		for(unsigned int x = 0; x < m_width; ++x) {
+			row[x] = image->getPixel(x, y).a;
+			if(row[x] != 0) {
+				if(m_spanStart[y] > (int)x)
+					m_spanStart[y] = (int)x;
+				m_spanEnd[y] = (int)x;
+			}
+
+			// keep track of the widest fully covered run
+			if(row[x] == 255) {
+				if(runStart == -1)
+					runStart = (int)x;
+				if((int)x - runStart > m_fullEnd[y] - m_fullStart[y]) {
+					m_fullStart[y] = runStart;
+					m_fullEnd[y] = (int)x;
+				}
+			} else {
+				runStart = -1;
+			}
+		}
+	}
+}
+
+Brush::~Brush()
+{
+	delete [] m_coverage;
+	delete [] m_spanStart;
+	delete [] m_spanEnd;
+	delete [] m_fullStart;
+	delete [] m_fullEnd;
+}
+
+unsigned int
+Brush::getWidth() const
+{
+	return m_width;
+}
+
+unsigned int
+Brush::getHeight() const
+{
+	return m_height;
+}
+
+const uint8_t *
+Brush::getCoverage(unsigned int row) const
+{
+	return m_coverage + (m_width * row);
+}
+
+int
+Brush::getSpanStart(unsigned int row) const
+{
+	return m_spanStart[row];
+}
+
+int
+Brush::getSpanEnd(unsigned int row) const
+{
+	return m_spanEnd[row];
+}
+
+int
+Brush::getFullStart(unsigned int row) const
+{
+	return m_fullStart[row];
+}
+
+int
+Brush::getFullEnd(unsigned int row) const
+{
+	return m_fullEnd[row];
+}
+
+Brush *
+Brush::load(const char *filename)
+{
+	Image *image = Image::load(filename);
+
+	Brush *brush;
+	try {
+		brush = new Brush(image);
+	} catch(...) {
+		delete image;
+		throw;
+	}
+
+	delete image;
+	return brush;
+}
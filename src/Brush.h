@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BRUSH_H__
+#define __BRUSH_H__
+
+#include "Image.h"
+
+/*
+ * A brush stamp prepared for drawing. The brush image is reduced to a
+ * packed coverage mask (one byte per texel, taken from the alpha channel
+ * when there is one) and, for each row, the first and last covered column
+ * so that drawing only has to visit the covered part of the stamp. The
+ * widest run of fully covered texels in each row is kept as well, since
+ * nothing under it needs per-texel coverage.
+ */
+class Brush
+{
+	private:
+		unsigned int m_width, m_height;
+		uint8_t *m_coverage;
+		int *m_spanStart, *m_spanEnd;
+		int *m_fullStart, *m_fullEnd;
+
+	public:
+		Brush(const Image *image);
+		virtual ~Brush();
+
+		unsigned int getWidth() const;
+		unsigned int getHeight() const;
+
+		const uint8_t *getCoverage(unsigned int row) const;
+		int getSpanStart(unsigned int row) const;
+		int getSpanEnd(unsigned int row) const;
+		int getFullStart(unsigned int row) const;
+		int getFullEnd(unsigned int row) const;
+
+		static Brush *load(const char *filename);
+};
+
+#endif /* __BRUSH_H__ */
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include "CanvasSaver.h"
+#include "Exception.h"
+#include "Util.h"
+
+using namespace std;
+
+CanvasSaver::CanvasSaver(unsigned int savedSerial)
+{
+	m_stopping = false;
+	m_pending = NULL;
+	m_writing = false;
+
+	m_savedSerial = savedSerial;
+	m_savesCompleted = 0;
+	m_savesSkipped = 0;
+	m_savesFailed = 0;
+}
+
+CanvasSaver::~CanvasSaver()
+{
+	stop();
+}
+
+static bool
+writeFile(const string &filename, const string &data)
+{
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if(!fp)
+		return false;
+
+	bool written = (fwrite(data.data(), 1, data.length(), fp) == data.length());
+	return (fclose(fp) == 0 && written);
+}
+
+/*
+ * Writes an image to filename in the format its extension gives.
+ */
+bool
+CanvasSaver::write(Image *image, const string &filename)
+{
+	// the format comes from the real name; the
+	// temporary name's extension means nothing
+	string tmpFilename = filename + ".tmp";
+
+	string data;
+	try {
+		if(Image::getFormat(filename) == Image::FORMAT_QOI)
+			image->encodeQoi(data);
+		else
+			image->encodePng(data);
+	} catch(Exception &ex) {
+		return false;
+	}
+
+	if(!writeFile(tmpFilename, data)) {
+		unlink(tmpFilename.c_str());
+		return false;
+	}
+
+	// make sure the data is on disk before the
+	// new file replaces the old one
+	if(!syncPath(tmpFilename) || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+		unlink(tmpFilename.c_str());
+		return false;
+	}
+
+	// sync the directory so the rename itself is durable
+	syncDirectoryOf(filename);
+
+	return true;
+}
+
+void
+CanvasSaver::run()
+{
+	m_mutex.lock();
+	while(true) {
+		while(!m_pending && !m_stopping)
+			m_condition.wait(&m_mutex);
+		if(!m_pending)
+			break;
+
+		Image *image = m_pending;
+		string filename = m_pendingFilename;
+		m_pending = NULL;
+		m_writing = true;
+
+		// encode and write without holding the lock
+		m_mutex.unlock();
+		bool result = write(image, filename);
+		m_mutex.lock();
+
+		m_writing = false;
+		if(result) {
+			m_savedSerial = image->getModificationSerial();
+			m_savedText = image->getTextEntries();
+			++m_savesCompleted;
+		} else {
+			++m_savesFailed;
+		}
+
+		delete image;
+	}
+	m_mutex.unlock();
+}
+
+/*
+ * Queues a snapshot to be written in the background. The saver takes
+ * ownership of the snapshot. Returns false, and counts the save as
+ * skipped, if another save is still in flight.
+ */
+bool
+CanvasSaver::save(Image *snapshot, const string &filename)
+{
+	m_mutex.lock();
+	if(m_pending || m_writing || m_stopping) {
+		++m_savesSkipped;
+		m_mutex.unlock();
+		delete snapshot;
+		return false;
+	}
+
+	m_pending = snapshot;
+	m_pendingFilename = filename;
+	m_condition.signal();
+	m_mutex.unlock();
+
+	return true;
+}
+
+/*
+ * Writes an image on the calling thread, for use
+ * once the background thread has been stopped.
+ */
+void
+CanvasSaver::saveNow(Image *image, const string &filename)
+{
+	bool result = write(image, filename);
+
+	MutexLocker locker(&m_mutex);
+	if(result) {
+		m_savedSerial = image->getModificationSerial();
+		m_savedText = image->getTextEntries();
+		++m_savesCompleted;
+	} else {
+		++m_savesFailed;
+	}
+}
+
+/*
+ * Finishes any queued save and stops the background thread.
+ */
+void
+CanvasSaver::stop()
+{
+	m_mutex.lock();
+	m_stopping = true;
+	m_condition.signal();
+	m_mutex.unlock();
+
+	join();
+}
+
+/*
+ * Returns the text stored under the given key in
+ * the last image saved, or an empty string.
+ */
+string
+CanvasSaver::getSavedText(const string &key)
+{
+	MutexLocker locker(&m_mutex);
+	map <string, string>::const_iterator i = m_savedText.find(key);
+	return (i == m_savedText.end()) ? string() : i->second;
+}
+
+unsigned int
+CanvasSaver::getSavedSerial()
+{
+	MutexLocker locker(&m_mutex);
+	return m_savedSerial;
+}
+
+int
+CanvasSaver::getSavesInFlight()
+{
+	MutexLocker locker(&m_mutex);
+	return (m_pending || m_writing) ? 1 : 0;
+}
+
+int
+CanvasSaver::getSavesCompleted()
+{
+	MutexLocker locker(&m_mutex);
+	return m_savesCompleted;
+}
+
+int
+CanvasSaver::getSavesSkipped()
+{
+	MutexLocker locker(&m_mutex);
+	return m_savesSkipped;
+}
+
+int
+CanvasSaver::getSavesFailed()
+{
+	MutexLocker locker(&m_mutex);
+	return m_savesFailed;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CANVASSAVER_H__
+#define __CANVASSAVER_H__
+
+#include <map>
+#include <string>
+#include "Image.h"
+#include "Thread.h"
+
+/*
+ * Writes canvas snapshots to disk on a background thread, so that
+ * request handlers never wait for an image to be encoded. Files are
+ * written to a temporary name, synced and then renamed into place, so
+ * a crash never leaves a partially written canvas behind. Only one save
+ * is in flight at a time; a save requested while another is still being
+ * written is skipped, since the next one will pick up its changes.
+ */
+class CanvasSaver : public Thread
+{
+	private:
+		Mutex m_mutex;
+		Condition m_condition;
+		bool m_stopping;
+
+		Image *m_pending;
+		std::string m_pendingFilename;
+		bool m_writing;
+
+		unsigned int m_savedSerial;
+		std::map <std::string, std::string> m_savedText;
+		int m_savesCompleted;
+		int m_savesSkipped;
+		int m_savesFailed;
+
+		bool write(Image *image, const std::string &filename);
+
+	protected:
+		void run();
+
+	public:
+		CanvasSaver(unsigned int savedSerial);
+		virtual ~CanvasSaver();
+
+		bool save(Image *snapshot, const std::string &filename);
+		void saveNow(Image *image, const std::string &filename);
+		void stop();
+
+		unsigned int getSavedSerial();
+		std::string getSavedText(const std::string &key);
+		int getSavesInFlight();
+		int getSavesCompleted();
+		int getSavesSkipped();
+		int getSavesFailed();
+};
+
+#endif /* __CANVASSAVER_H__ */
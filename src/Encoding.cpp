@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Encoding.h"
+
+using namespace std;
+
+static const char *BASE64_CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+void
+appendVarint(string &s, uint32_t value)
+{
+	while(value >= 0x80) {
+		s += (char)((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	s += (char)value;
+}
+
+bool
+readVarint(const unsigned char *&p, const unsigned char *end, uint32_t &value)
+{
+	value = 0;
+	for(unsigned int shift = 0; shift < 35; shift += 7) {
+		if(p == end)
+			return false;
+
+		unsigned char c = *p++;
+		value |= (uint32_t)(c & 0x7f) << shift;
+		if((c & 0x80) == 0)
+			return true;
+	}
+
+	// more than five bytes can't be a 32-bit value
+	return false;
+}
+
+void
+appendSignedVarint(string &s, int32_t value)
+{
+	appendVarint(s, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+bool
+readSignedVarint(const unsigned char *&p, const unsigned char *end, int32_t &value)
+{
+	uint32_t u;
+	if(!readVarint(p, end, u))
+		return false;
+
+	value = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+	return true;
+}
+
+/*
+ * Fixed-size values are stored most significant byte first.
+ */
+void
+appendUInt32(string &s, uint32_t value)
+{
+	s += (char)(value >> 24);
+	s += (char)(value >> 16);
+	s += (char)(value >> 8);
+	s += (char)value;
+}
+
+bool
+readUInt32(const unsigned char *&p, const unsigned char *end, uint32_t &value)
+{
+	if(end - p < 4)
+		return false;
+
+	value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	p += 4;
+	return true;
+}
+
+/*
+ * Appends the base64 form of bytes to s.
+ */
+void
+encodeBase64(const string &bytes, string &s)
+{
+	const unsigned char *p = (const unsigned char *)bytes.data();
+	size_t length = bytes.length();
+
+	s.reserve(s.length() + ((length * 4) + 2) / 3);
+	size_t i = 0;
+	for(; i + 3 <= length; i += 3) {
+		uint32_t v = ((uint32_t)p[i] << 16) | ((uint32_t)p[i + 1] << 8) | (uint32_t)p[i + 2];
+		s += BASE64_CHARS[(v >> 18) & 0x3f];
+		s += BASE64_CHARS[(v >> 12) & 0x3f];
+		s += BASE64_CHARS[(v >> 6) & 0x3f];
+		s += BASE64_CHARS[v & 0x3f];
+	}
+
+	// the last one or two bytes, without padding
+	if(i < length) {
+		uint32_t v = (uint32_t)p[i] << 16;
+		if(i + 1 < length)
+			v |= (uint32_t)p[i + 1] << 8;
+		s += BASE64_CHARS[(v >> 18) & 0x3f];
+		s += BASE64_CHARS[(v >> 12) & 0x3f];
+		if(i + 1 < length)
+			s += BASE64_CHARS[(v >> 6) & 0x3f];
+	}
+}
+
+static int
+getBase64Value(char c)
+{
+	if(c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if(c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if(c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if(c == '-')
+		return 62;
+	if(c == '_')
+		return 63;
+
+	return -1;
+}
+
+/*
+ * Decodes base64 text into bytes. Returns false if the
+ * text contains anything other than base64 characters.
+ */
+bool
+decodeBase64(const string &s, string &bytes)
+{
+	bytes.clear();
+	if((s.length() % 4) == 1)
+		return false;
+	bytes.reserve((s.length() * 3) / 4);
+
+	uint32_t v = 0;
+	unsigned int bits = 0;
+	for(size_t i = 0; i < s.length(); ++i) {
+		int value = getBase64Value(s[i]);
+		if(value < 0)
+			return false;
+
+		v = (v << 6) | (uint32_t)value;
+		bits += 6;
+		if(bits >= 8) {
+			bits -= 8;
+			bytes += (char)(v >> bits);
+		}
+	}
+
+	return true;
+}
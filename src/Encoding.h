@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ENCODING_H__
+#define __ENCODING_H__
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Helpers for the binary update format. Unsigned varints are stored
+ * seven bits at a time, least significant group first, with the high
+ * bit of each byte set if more follow. Signed values are zig-zag
+ * encoded first so small magnitudes of either sign stay short. Binary
+ * payloads travel as URL-safe base64 without padding, so they can be
+ * put in form fields and update lines as they are.
+ */
+void appendVarint(std::string &s, uint32_t value);
+bool readVarint(const unsigned char *&p, const unsigned char *end, uint32_t &value);
+
+void appendSignedVarint(std::string &s, int32_t value);
+bool readSignedVarint(const unsigned char *&p, const unsigned char *end, int32_t &value);
+
+void appendUInt32(std::string &s, uint32_t value);
+bool readUInt32(const unsigned char *&p, const unsigned char *end, uint32_t &value);
+
+void encodeBase64(const std::string &bytes, std::string &s);
+bool decodeBase64(const std::string &s, std::string &bytes);
+
+#endif /* __ENCODING_H__ */
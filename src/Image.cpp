@@ -23,10 +23,14 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cstdio>
 #include <cstring>
 #include <png.h>
+#include <vector>
 #include "Exception.h"
+#include "ImageView.h"
 #include "PngImage.h"
+#include "QoiImage.h"
 
 using namespace std;
 
@@ -37,6 +41,7 @@ Image::Image()
 {
 	m_data = NULL;
 	m_width = m_height = m_colorComponents = 0;
+	initTiles();
 }
 
 Image::Image(unsigned int width, unsigned int height,
@@ -49,6 +54,8 @@ Image::Image(unsigned int width, unsigned int height,
 	m_data = new uint8_t[m_width * m_height * m_colorComponents];
 	for(unsigned int i = 0; i < m_width * m_height * m_colorComponents; ++i)
 		m_data[i] = 255;
+
+	initTiles();
 }
 
 Image::~Image()
@@ -57,6 +64,15 @@ Image::~Image()
 		delete [] m_data;
 }
 
+void
+Image::initTiles()
+{
+	m_serial = 0;
+	m_tileColumns = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+	m_tileRows = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+	m_tileSerials.assign(m_tileColumns * m_tileRows, 0);
+}
+
 string
 Image::getFilename() const
 {
@@ -69,6 +85,12 @@ Image::getData() const
 	return m_data;
 }
 
+uint8_t *
+Image::getData()
+{
+	return m_data;
+}
+
 unsigned int
 Image::getWidth() const
 {
@@ -87,43 +109,68 @@ Image::getNumComponents() const
 	return m_colorComponents;
 }
 
-Color
-Image::getPixel(unsigned int x, unsigned int y) const
+const uint8_t *
+Image::getSpan(unsigned int x, unsigned int y, unsigned int *length) const
 {
 	if(!m_data)
-		throw Exception("Image::getPixel(): No image data available");
+		throw Exception("Image::getSpan(): No image data available");
 
+	if(x >= m_width || y >= m_height)
+		throw Exception("Image::getSpan(): Pixel is out of image bounds");
+
+	if(length)
+		*length = m_width - x;
+	return m_data + (((m_width * y) + x) * m_colorComponents);
+}
+
+uint8_t *
+Image::getSpan(unsigned int x, unsigned int y, unsigned int *length)
+{
+	return (uint8_t *)((const Image *)this)->getSpan(x, y, length);
+}
+
+void
+Image::readRow(unsigned int y, uint8_t *buffer) const
+{
+	for(unsigned int x = 0; x < m_width;) {
+		unsigned int length;
+		const uint8_t *span = getSpan(x, y, &length);
+		memcpy(buffer + (x * m_colorComponents), span, length * m_colorComponents);
+		x += length;
+	}
+}
+
+Color
+Image::getPixel(unsigned int x, unsigned int y) const
+{
 	if(x >= m_width || y >= m_height)
 		throw Exception("Image::getPixel(): Pixel is out of image bounds");
 
+	const uint8_t *p = getSpan(x, y, NULL);
 	Color pixel;
-	int tmp;
 
 	switch(m_colorComponents) {
 		default:
 			break;
 		case 1:
-			pixel.r = pixel.g = pixel.b = m_data[(m_width * y) + x];
+			pixel.r = pixel.g = pixel.b = p[0];
 			pixel.a = 255;
 			break;
 		case 2:
-			tmp = ((m_width * y) + x) * 2;
-			pixel.r = pixel.g = pixel.b = m_data[tmp + 0];
-			pixel.a = m_data[tmp + 1];
+			pixel.r = pixel.g = pixel.b = p[0];
+			pixel.a = p[1];
 			break;
 		case 3:
-			tmp = ((m_width * y) + x) * 3;
-			pixel.r = m_data[tmp + 0];
-			pixel.g = m_data[tmp + 1];
-			pixel.b = m_data[tmp + 2];
+			pixel.r = p[0];
+			pixel.g = p[1];
+			pixel.b = p[2];
 			pixel.a = 255;
 			break;
 		case 4:
-			tmp = ((m_width * y) + x) * 4;
-			pixel.r = m_data[tmp + 0];
-			pixel.g = m_data[tmp + 1];
-			pixel.b = m_data[tmp + 2];
-			pixel.a = m_data[tmp + 3];
+			pixel.r = p[0];
+			pixel.g = p[1];
+			pixel.b = p[2];
+			pixel.a = p[3];
 			break;
 	}
 
@@ -133,36 +180,167 @@ Image::getPixel(unsigned int x, unsigned int y) const
 void
 Image::setPixel(unsigned int x, unsigned int y, Color c)
 {
-	if(!m_data)
-		throw Exception("Image::setPixel(): No image data available");
-
 	if(x >= m_width || y >= m_height)
 		throw Exception("Image::setPixel(): Pixel is out of image bounds");
 
+	uint8_t *p = getSpan(x, y, NULL);
+	markDirty(x, y, 1, 1);
+
 	switch(m_colorComponents) {
 		default:
 			break;
 		case 1:
-			m_data[(m_width * y) + x] = c.r;
+			p[0] = c.r;
 			break;
 		case 2:
-			m_data[(m_width * 2 * y) + (x * 2) + 0] = c.r;
-			m_data[(m_width * 2 * y) + (x * 2) + 1] = c.a;
+			p[0] = c.r;
+			p[1] = c.a;
 			break;
 		case 3:
-			m_data[(m_width * 3 * y) + (x * 3) + 0] = c.r;
-			m_data[(m_width * 3 * y) + (x * 3) + 1] = c.g;
-			m_data[(m_width * 3 * y) + (x * 3) + 2] = c.b;
+			p[0] = c.r;
+			p[1] = c.g;
+			p[2] = c.b;
 			break;
 		case 4:
-			m_data[(m_width * 4 * y) + (x * 4) + 0] = c.r;
-			m_data[(m_width * 4 * y) + (x * 4) + 1] = c.g;
-			m_data[(m_width * 4 * y) + (x * 4) + 2] = c.b;
-			m_data[(m_width * 4 * y) + (x * 4) + 3] = c.a;
+			p[0] = c.r;
+			p[1] = c.g;
+			p[2] = c.b;
+			p[3] = c.a;
 			break;
 	}
 }
 
+Image *
+Image::snapshot() const
+{
+	if(!m_data)
+		throw Exception("Image::snapshot(): No image data available");
+
+	Image *image = new Image(m_width, m_height, m_colorComponents);
+	memcpy(image->m_data, m_data, m_width * m_height * m_colorComponents);
+	image->m_serial = m_serial;
+	image->m_tileSerials = m_tileSerials;
+	image->m_text = m_text;
+
+	return image;
+}
+
+/*
+ * Returns the text stored with the image under the given
+ * key, or an empty string if there isn't any.
+ */
+string
+Image::getText(const string &key) const
+{
+	map <string, string>::const_iterator i = m_text.find(key);
+	return (i == m_text.end()) ? string() : i->second;
+}
+
+void
+Image::setText(const string &key, const string &value)
+{
+	m_text[key] = value;
+}
+
+const map <string, string> &
+Image::getTextEntries() const
+{
+	return m_text;
+}
+
+void
+Image::markDirty(unsigned int x, unsigned int y, unsigned int width,
+                 unsigned int height)
+{
+	// clip the region to the image
+	if(x >= m_width || y >= m_height || width == 0 || height == 0)
+		return;
+	if(width > m_width - x)
+		width = m_width - x;
+	if(height > m_height - y)
+		height = m_height - y;
+
+	unsigned int serial = __sync_add_and_fetch(&m_serial, 1);
+	unsigned int lastColumn = (x + width - 1) / TILE_SIZE;
+	unsigned int lastRow = (y + height - 1) / TILE_SIZE;
+	for(unsigned int row = y / TILE_SIZE; row <= lastRow; ++row) {
+		for(unsigned int column = x / TILE_SIZE; column <= lastColumn; ++column)
+			m_tileSerials[(row * m_tileColumns) + column] = serial;
+	}
+}
+
+unsigned int
+Image::getModificationSerial() const
+{
+	return __sync_fetch_and_add((unsigned int *)&m_serial, 0);
+}
+
+bool
+Image::isDirty(unsigned int serial) const
+{
+	return (getModificationSerial() != serial);
+}
+
+unsigned int
+Image::getTileColumns() const
+{
+	return m_tileColumns;
+}
+
+unsigned int
+Image::getTileRows() const
+{
+	return m_tileRows;
+}
+
+bool
+Image::isTileDirty(unsigned int column, unsigned int row,
+                   unsigned int serial) const
+{
+	if(column >= m_tileColumns || row >= m_tileRows)
+		throw Exception("Image::isTileDirty(): Tile is out of image bounds");
+
+	// serials only ever grow, but compare the difference
+	// so that wrapping around doesn't matter
+	return ((int)(m_tileSerials[(row * m_tileColumns) + column] - serial) > 0);
+}
+
+template <int N> static void
+scalePixels(ImageView<N> dest, ImageView<N> source)
+{
+	unsigned int width = dest.getWidth();
+	unsigned int height = dest.getHeight();
+
+	// find the source column of each destination column once
+	vector <unsigned int> columns(width);
+	for(unsigned int x = 0; x < width; ++x) {
+		columns[x] = (unsigned int)(((float)x / (float)width) * (float)source.getWidth());
+		if(columns[x] >= source.getWidth())
+			columns[x] = source.getWidth() - 1;
+	}
+
+	vector <uint8_t> row(source.getWidth() * N);
+	unsigned int rowY = source.getHeight();
+	for(unsigned int y = 0; y < height; ++y) {
+		unsigned int src_y = (unsigned int)(((float)y / (float)height) * (float)source.getHeight());
+		if(src_y >= source.getHeight())
+			src_y = source.getHeight() - 1;
+
+		if(src_y != rowY) {
+			source.readRow(src_y, &row[0]);
+			rowY = src_y;
+		}
+
+		for(unsigned int x = 0; x < width;) {
+			unsigned int length;
+			uint8_t *span = dest.getSpan(x, y, &length);
+			for(unsigned int i = 0; i < length; ++i)
+				memcpy(span + (i * N), &row[columns[x + i] * N], N);
+			x += length;
+		}
+	}
+}
+
 Image *
 Image::scale(unsigned int width, unsigned int height)
 {
@@ -174,18 +352,69 @@ Image::scale(unsigned int width, unsigned int height)
 	Image *image = new Image(width, height, m_colorComponents);
 
 	// set the pixels of the new image
-	for(unsigned int y = 0; y < height; ++y) {
-		for(unsigned int x = 0; x < width; ++x) {
-			unsigned int src_y = (unsigned int)(((float)y / (float)height) * (float)m_height);
-			unsigned int src_x = (unsigned int)(((float)x / (float)width) * (float)m_width);
+	switch(m_colorComponents) {
+		default:
+			delete image;
+			throw Exception("Image::scale(): Invalid number of color components");
+			break;
+		case 1:
+			scalePixels(ImageView<1>(image), ImageView<1>(this));
+			break;
+		case 2:
+			scalePixels(ImageView<2>(image), ImageView<2>(this));
+			break;
+		case 3:
+			scalePixels(ImageView<3>(image), ImageView<3>(this));
+			break;
+		case 4:
+			scalePixels(ImageView<4>(image), ImageView<4>(this));
+			break;
+	}
+
+	return image;
+}
 
-			image->setPixel(x, y, getPixel(src_x, src_y));
+/*
+ * Returns a copy of a rectangle of the image, clipped to the image.
+ */
+Image *
+Image::crop(unsigned int x, unsigned int y, unsigned int width,
+            unsigned int height) const
+{
+	if(x >= m_width || y >= m_height || width == 0 || height == 0)
+		throw Exception("Image::crop(): Region is outside of the image");
+	if(width > m_width - x)
+		width = m_width - x;
+	if(height > m_height - y)
+		height = m_height - y;
+
+	Image *image = new Image(width, height, m_colorComponents);
+	for(unsigned int row = 0; row < height; ++row) {
+		uint8_t *dest = image->m_data + (row * width * m_colorComponents);
+		for(unsigned int column = 0; column < width;) {
+			unsigned int length;
+			const uint8_t *span = getSpan(x + column, y + row, &length);
+			if(length > width - column)
+				length = width - column;
+			memcpy(dest + (column * m_colorComponents), span, length * m_colorComponents);
+			column += length;
 		}
 	}
 
 	return image;
 }
 
+template <int N> static void
+copyRows(ImageView<N> dest, ImageView<N> source, unsigned int width,
+         unsigned int height)
+{
+	vector <uint8_t> row(source.getWidth() * N);
+	for(unsigned int y = 0; y < height; ++y) {
+		source.readRow(y, &row[0]);
+		dest.writeRow(y, &row[0], width);
+	}
+}
+
 void
 Image::copyFrom(Image *image)
 {
@@ -197,20 +426,80 @@ Image::copyFrom(Image *image)
 	if(m_height < h)
 		h = m_height;
 
-	// copy pixels
+	markDirty(0, 0, w, h);
+
+	// copy whole rows when the pixel formats match
+	if(image->getNumComponents() == m_colorComponents) {
+		switch(m_colorComponents) {
+			default:
+				break;
+			case 1:
+				copyRows(ImageView<1>(this), ImageView<1>(image), w, h);
+				return;
+			case 2:
+				copyRows(ImageView<2>(this), ImageView<2>(image), w, h);
+				return;
+			case 3:
+				copyRows(ImageView<3>(this), ImageView<3>(image), w, h);
+				return;
+			case 4:
+				copyRows(ImageView<4>(this), ImageView<4>(image), w, h);
+				return;
+		}
+	}
+
+	// otherwise convert each pixel
 	for(unsigned int y = 0; y < h; ++y) {
 		for(unsigned int x = 0; x < w; ++x)
 			setPixel(x, y, image->getPixel(x, y));
 	}
 }
 
+static void
+writePngData(png_structp png, png_bytep data, png_size_t length)
+{
+	string *s = (string *)png_get_io_ptr(png);
+	s->append((const char *)data, length);
+}
+
+static void
+flushPngData(png_structp /*png*/)
+{
+}
+
+/*
+ * Stores text in uncompressed tEXt chunks; libpng
+ * copies the text, so it only needs to live this long.
+ */
+static void
+setPngText(png_structp png, png_infop info, const map <string, string> &entries)
+{
+	if(entries.empty())
+		return;
+
+	vector <png_text> text(entries.size());
+	size_t n = 0;
+	for(map <string, string>::const_iterator i = entries.begin(); i != entries.end(); ++i, ++n) {
+		memset(&text[n], 0, sizeof(png_text));
+		text[n].compression = PNG_TEXT_COMPRESSION_NONE;
+		text[n].key = (png_charp)i->first.c_str();
+		text[n].text = (png_charp)i->second.c_str();
+		text[n].text_length = i->second.length();
+	}
+	png_set_text(png, info, &text[0], (int)text.size());
+}
+
+/*
+ * Encodes the image as a PNG, writing it to fp if given or
+ * appending it to data otherwise.
+ */
 void
-Image::save(const char *filename)
+Image::writePng(FILE *fp, string *data) const
 {
 	int colorType;
 	switch(m_colorComponents) {
 		default:
-			throw Exception("Image::save(): Invalid number of color components");
+			throw Exception("Image::writePng(): Invalid number of color components");
 			break;
 		case 1:
 			colorType = PNG_COLOR_TYPE_GRAY;
@@ -226,49 +515,86 @@ Image::save(const char *filename)
 			break;
 	}
 
-	FILE *fp = fopen(filename, "wb");
-	if(!fp) {
-		throw Exception(string("Image::save(): Unable to open ") + filename + " for writing");
-		return;
-	}
-
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if(!png) {
-		fclose(fp);
-		throw Exception("Image::save(): png_create_write_struct failed");
+		throw Exception("Image::writePng(): png_create_write_struct failed");
 		return;
 	}
 
 	png_infop info = png_create_info_struct(png);
 	if(!info) {
 		png_destroy_write_struct(&png, NULL);
-		fclose(fp);
-		throw Exception("Image::save(): png_create_info_struct failed");
+		throw Exception("Image::writePng(): png_create_info_struct failed");
 		return;
 	}
 
 	if(setjmp(png_jmpbuf(png))) {
 		png_destroy_write_struct(&png, &info);
-		fclose(fp);
-		throw Exception("Image::save(): setjmp failed");
+		throw Exception("Image::writePng(): setjmp failed");
 		return;
 	}
 
-	png_init_io(png, fp);
+	if(fp)
+		png_init_io(png, fp);
+	else
+		png_set_write_fn(png, data, writePngData, flushPngData);
 
 	png_set_IHDR(png, info, m_width, m_height, 8, colorType, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	setPngText(png, info, m_text);
 
-	png_bytepp rows = new png_bytep[m_height];
-	for(unsigned int i = 0; i < m_height; ++i)
-		rows[i] = m_data + (m_width * m_colorComponents * i);
+	png_write_info(png, info);
 
-	png_set_rows(png, info, rows);
-	png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
+	// write rows straight from the image data when it's contiguous,
+	// otherwise gather each row into a buffer first
+	png_bytep row = NULL;
+	if(!m_data)
+		row = new png_byte[m_width * m_colorComponents];
+	for(unsigned int i = 0; i < m_height; ++i) {
+		if(m_data) {
+			png_write_row(png, m_data + (m_width * m_colorComponents * i));
+		} else {
+			readRow(i, row);
+			png_write_row(png, row);
+		}
+	}
+	png_write_end(png, info);
 
 	png_destroy_write_struct(&png, &info);
-	fclose(fp);
 
-	delete [] rows;
+	if(row)
+		delete [] row;
+}
+
+void
+Image::save(const char *filename)
+{
+	// QOI is encoded to memory first, so check the format
+	// before anything is written
+	Format format = getFormat(filename);
+	string data;
+	if(format == FORMAT_QOI)
+		encodeQoi(data);
+
+	FILE *fp = fopen(filename, "wb");
+	if(!fp) {
+		throw Exception(string("Image::save(): Unable to open ") + filename + " for writing");
+		return;
+	}
+
+	try {
+		if(format == FORMAT_QOI) {
+			if(fwrite(data.data(), 1, data.length(), fp) != data.length())
+				throw Exception(string("Image::save(): Unable to write ") + filename);
+		} else {
+			writePng(fp, NULL);
+		}
+	} catch(...) {
+		fclose(fp);
+		throw;
+	}
+
+	if(fclose(fp) != 0)
+		throw Exception(string("Image::save(): Unable to write ") + filename);
 }
 
 void
@@ -277,21 +603,138 @@ Image::save(const string &filename)
 	save(filename.c_str());
 }
 
-Image *
-Image::load(const string &filename)
+void
+Image::encodePng(string &data) const
+{
+	data.clear();
+	writePng(NULL, &data);
+}
+
+static void
+appendUInt32(string &s, uint32_t value)
+{
+	s += (char)((value >> 24) & 0xff);
+	s += (char)((value >> 16) & 0xff);
+	s += (char)((value >> 8) & 0xff);
+	s += (char)(value & 0xff);
+}
+
+/*
+ * Encodes the image as a QOI file, replacing the contents of data,
+ * with the image's text after the end marker.
+ */
+void
+Image::encodeQoi(string &data) const
+{
+	if(m_colorComponents != 3 && m_colorComponents != 4)
+		throw Exception("Image::encodeQoi(): Invalid number of color components");
+
+	data.clear();
+	data.reserve(QoiImage::HEADER_SIZE + (m_width * m_height) + sizeof(QoiImage::END_MARKER));
+	data.append("qoif", 4);
+	appendUInt32(data, m_width);
+	appendUInt32(data, m_height);
+	data += (char)m_colorComponents;
+	data += (char)0;
+
+	uint8_t index[64 * 4];
+	memset(index, 0, sizeof(index));
+	uint8_t prev[4] = { 0, 0, 0, 255 };
+	uint8_t px[4] = { 0, 0, 0, 255 };
+	unsigned int run = 0;
+
+	vector <uint8_t> row(m_width * m_colorComponents);
+	for(unsigned int y = 0; y < m_height; ++y) {
+		readRow(y, &row[0]);
+		const uint8_t *p = &row[0];
+		for(unsigned int x = 0; x < m_width; ++x, p += m_colorComponents) {
+			memcpy(px, p, m_colorComponents);
+
+			if(memcmp(px, prev, 4) == 0) {
+				if(++run == 62) {
+					data += (char)(QoiImage::OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+
+			if(run > 0) {
+				data += (char)(QoiImage::OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			unsigned int slot = QoiImage::hash(px);
+			if(memcmp(index + (slot * 4), px, 4) == 0) {
+				data += (char)(QoiImage::OP_INDEX | slot);
+			} else {
+				memcpy(index + (slot * 4), px, 4);
+
+				if(px[3] == prev[3]) {
+					int dr = (int8_t)(px[0] - prev[0]);
+					int dg = (int8_t)(px[1] - prev[1]);
+					int db = (int8_t)(px[2] - prev[2]);
+					int drg = dr - dg;
+					int dbg = db - dg;
+
+					if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+						data += (char)(QoiImage::OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+					} else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+						data += (char)(QoiImage::OP_LUMA | (dg + 32));
+						data += (char)(((drg + 8) << 4) | (dbg + 8));
+					} else {
+						data += (char)QoiImage::OP_RGB;
+						data.append((const char *)px, 3);
+					}
+				} else {
+					data += (char)QoiImage::OP_RGBA;
+					data.append((const char *)px, 4);
+				}
+			}
+
+			memcpy(prev, px, 4);
+		}
+	}
+	if(run > 0)
+		data += (char)(QoiImage::OP_RUN | (run - 1));
+
+	data.append((const char *)QoiImage::END_MARKER, sizeof(QoiImage::END_MARKER));
+
+	for(map <string, string>::const_iterator i = m_text.begin(); i != m_text.end(); ++i) {
+		data += i->first;
+		data += '\0';
+		appendUInt32(data, i->second.length());
+		data += i->second;
+	}
+}
+
+/*
+ * Returns the format of an image file by its extension.
+ */
+Image::Format
+Image::getFormat(const string &filename)
 {
 	// get file extension position
 	size_t tmp = filename.find_last_of('.');
 	if(tmp == string::npos)
-		throw Exception(string("Image::load(): No file extension: ") + filename);
+		throw Exception(string("Image::getFormat(): No file extension: ") + filename);
 
-	// get file extension and use it to call the
-	// appropriate function to load the image
 	string extension = filename.substr(tmp);
 	if(strcasecmp(extension.c_str(), ".png") == 0)
-		return PngImage::load(filename.c_str());
+		return FORMAT_PNG;
+	else if(strcasecmp(extension.c_str(), ".qoi") == 0)
+		return FORMAT_QOI;
+	else
+		throw Exception(string("Image::getFormat(): Unsupported file extension: ") + filename);
+}
+
+Image *
+Image::load(const string &filename)
+{
+	// use the appropriate function to load the image
+	if(getFormat(filename) == FORMAT_QOI)
+		return QoiImage::load(filename.c_str());
 	else
-		throw Exception(string("Image::load(): Unsupported file extension: ") + filename);
+		return PngImage::load(filename.c_str());
 }
 
 Image *
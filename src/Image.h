@@ -26,39 +26,90 @@
 #ifndef __IMAGE_H__
 #define __IMAGE_H__
 
+#include <cstdio>
+#include <map>
 #include <string>
+#include <vector>
 #include "Color.h"
 
 class Image {
+	public:
+		// dirty regions are tracked in square tiles of this size
+		static const unsigned int TILE_SIZE = 64;
+
+		// file formats, chosen by the file's extension
+		enum Format {
+			FORMAT_PNG,
+			FORMAT_QOI
+		};
+
 	protected:
 		std::string m_filename;
 		uint8_t *m_data;
 		unsigned int m_width, m_height;
 		int m_colorComponents;
 
+		// every modification bumps m_serial and stamps the tiles it
+		// touched with the new value; consumers remember the serial
+		// they last saw, so each one can reset its view of what's dirty;
+		// m_serial is bumped atomically, so threads drawing in different
+		// tiles at once each get a serial of their own
+		volatile unsigned int m_serial;
+		unsigned int m_tileColumns, m_tileRows;
+		std::vector <unsigned int> m_tileSerials;
+
+		// key, value pairs stored in tEXt chunks of PNG files
+		std::map <std::string, std::string> m_text;
+
 		Image();
+		void initTiles();
+		void writePng(FILE *fp, std::string *data) const;
 
 	public:
 		Image(unsigned int width, unsigned int height, int colorComponents);
 		virtual ~Image();
 
 		std::string getFilename() const;
+		// NULL for images that don't keep their pixels in one buffer
 		const uint8_t *getData() const;
+		uint8_t *getData();
 		unsigned int getWidth() const;
 		unsigned int getHeight() const;
 		int getNumComponents() const;
 
+		// pointer to pixel (x, y) and, through length, how many pixels
+		// follow it contiguously in the same row
+		virtual const uint8_t *getSpan(unsigned int x, unsigned int y, unsigned int *length) const;
+		virtual uint8_t *getSpan(unsigned int x, unsigned int y, unsigned int *length);
+		void readRow(unsigned int y, uint8_t *buffer) const;
+
 		Color getPixel(unsigned int x, unsigned int y) const;
 		void setPixel(unsigned int x, unsigned int y, Color c);
 		void copyFrom(Image *image);
 
+		std::string getText(const std::string &key) const;
+		void setText(const std::string &key, const std::string &value);
+		const std::map <std::string, std::string> &getTextEntries() const;
+
+		void markDirty(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+		unsigned int getModificationSerial() const;
+		bool isDirty(unsigned int serial) const;
+		unsigned int getTileColumns() const;
+		unsigned int getTileRows() const;
+		bool isTileDirty(unsigned int column, unsigned int row, unsigned int serial) const;
+
 		Image *scale(unsigned int width, unsigned int height);
+		Image *crop(unsigned int x, unsigned int y, unsigned int width, unsigned int height) const;
+		virtual Image *snapshot() const;
 
 		void save(const char *filename);
 		void save(const std::string &filename);
+		void encodePng(std::string &data) const;
+		void encodeQoi(std::string &data) const;
 
 		static Image *load(const std::string &filename);
 		static Image *load(const char *filename);
+		static Format getFormat(const std::string &filename);
 };
 
 #endif /* __IMAGE_H__ */
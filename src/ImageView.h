@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __IMAGEVIEW_H__
+#define __IMAGEVIEW_H__
+
+#include <cstring>
+#include "Exception.h"
+#include "Image.h"
+
+/*
+ * Unchecked access to the pixels of an image with N color components.
+ * The component count is a compile-time constant, so pixel addressing and
+ * per-pixel copies compile down to plain pointer arithmetic. Images that
+ * keep their pixels in one buffer are addressed directly; others (such
+ * as TiledImage) hand out contiguous spans through Image::getSpan. Bounds
+ * are not checked; use Image::getPixel and Image::setPixel where that
+ * matters.
+ */
+template <int N>
+class ImageView
+{
+	private:
+		Image *m_image;
+		uint8_t *m_data;
+		unsigned int m_width, m_height;
+
+	public:
+		ImageView(Image *image)
+		{
+			if(image->getNumComponents() != N)
+				throw Exception("ImageView::ImageView(): Image has the wrong number of color components");
+
+			m_image = image;
+			m_data = image->getData();
+			m_width = image->getWidth();
+			m_height = image->getHeight();
+		}
+
+		unsigned int getWidth() const
+		{
+			return m_width;
+		}
+
+		unsigned int getHeight() const
+		{
+			return m_height;
+		}
+
+		uint8_t *getSpan(unsigned int x, unsigned int y, unsigned int *length) const
+		{
+			if(!m_data)
+				return m_image->getSpan(x, y, length);
+
+			*length = m_width - x;
+			return m_data + (((m_width * y) + x) * N);
+		}
+
+		void readRow(unsigned int y, uint8_t *buffer) const
+		{
+			if(!m_data)
+				((const Image *)m_image)->readRow(y, buffer);
+			else
+				memcpy(buffer, m_data + (m_width * N * y), m_width * N);
+		}
+
+		void writeRow(unsigned int y, const uint8_t *buffer, unsigned int width) const
+		{
+			for(unsigned int x = 0; x < width;) {
+				unsigned int length;
+				uint8_t *span = getSpan(x, y, &length);
+				if(length > width - x)
+					length = width - x;
+				memcpy(span, buffer + (x * N), length * N);
+				x += length;
+			}
+		}
+};
+
+#endif /* __IMAGEVIEW_H__ */
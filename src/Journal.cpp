@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <xviweb/String.h>
+#include "Encoding.h"
+#include "Exception.h"
+#include "Journal.h"
+#include "Util.h"
+
+using namespace std;
+
+// milliseconds to wait before writing records again after a failure
+static const long RETRY_DELAY = 100;
+
+Journal::Journal(const string &filename)
+{
+	m_filename = filename;
+	m_stopping = false;
+	m_segment = 0;
+	m_discardedBefore = 0;
+
+	m_fd = -1;
+	m_fdSegment = 0;
+	m_fdLength = -1;
+
+	m_records = 0;
+	m_bytes = 0;
+	m_commits = 0;
+	m_failures = 0;
+	m_dropped = 0;
+	m_replayed = 0;
+}
+
+Journal::~Journal()
+{
+	stop();
+}
+
+string
+Journal::getSegmentFilename(unsigned int segment) const
+{
+	return m_filename + ".journal." + String::fromInt((int)segment);
+}
+
+/*
+ * Finds the numbers of the journal's segment files, in ascending order.
+ */
+void
+Journal::getSegments(vector <unsigned int> &segments) const
+{
+	size_t tmp = m_filename.find_last_of('/');
+	string directory = (tmp == string::npos) ? string(".") : m_filename.substr(0, tmp + 1);
+	string prefix = ((tmp == string::npos) ? m_filename : m_filename.substr(tmp + 1)) + ".journal.";
+
+	segments.clear();
+	DIR *dir = opendir(directory.c_str());
+	if(!dir)
+		return;
+
+	struct dirent *entry;
+	while((entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if(name.length() <= prefix.length() || name.compare(0, prefix.length(), prefix) != 0)
+			continue;
+		if(name.find_first_not_of("0123456789", prefix.length()) != string::npos)
+			continue;
+
+		segments.push_back((unsigned int)strtoul(name.c_str() + prefix.length(), NULL, 10));
+	}
+	closedir(dir);
+
+	sort(segments.begin(), segments.end());
+}
+
+/*
+ * Draws the updates in a segment on the image. Returns false if the
+ * segment ends with a damaged record.
+ */
+bool
+Journal::replaySegment(unsigned int segment, Image *image, Painter *painter)
+{
+	FILE *fp = fopen(getSegmentFilename(segment).c_str(), "rb");
+	if(!fp)
+		return true;
+
+	string data;
+	char buf[8192];
+	size_t length;
+	while((length = fread(buf, 1, sizeof(buf), fp)) > 0)
+		data.append(buf, length);
+	fclose(fp);
+
+	const unsigned char *p = (const unsigned char *)data.data();
+	const unsigned char *end = p + data.length();
+	while(p < end) {
+		uint32_t size, crc;
+		if(!readVarint(p, end, size) || size > (uint32_t)(end - p))
+			return false;
+		const unsigned char *payload = p;
+		p += size;
+		if(!readUInt32(p, end, crc) || crc != crc32(0L, payload, size))
+			return false;
+
+		PaintUpdate update;
+		if(!update.decode(string((const char *)payload, size)))
+			continue;
+
+		try {
+			painter->processUpdate(image, update.brushSize, update.brushColor, update.stroke);
+		} catch(Exception &ex) {
+			// an update that can't be drawn is skipped; posts with
+			// bad brush sizes are turned away, but older journals
+			// may still hold them
+		}
+		++m_replayed;
+	}
+
+	return true;
+}
+
+/*
+ * Brings the image up to date by drawing the updates in the segments
+ * from firstSegment onwards, and deletes the segments before it, which
+ * the image already holds. Updates appended afterwards go to a new
+ * segment. The journal must be started after it's opened.
+ */
+void
+Journal::open(unsigned int firstSegment, Image *image)
+{
+	vector <unsigned int> segments;
+	getSegments(segments);
+
+	Painter *painter = NULL;
+	m_segment = firstSegment;
+	for(size_t i = 0; i < segments.size(); ++i) {
+		if(segments[i] < firstSegment) {
+			unlink(getSegmentFilename(segments[i]).c_str());
+			continue;
+		}
+
+		if(!painter)
+			painter = new Painter();
+		if(!replaySegment(segments[i], image, painter))
+			cout << "Journal::open(): " << getSegmentFilename(segments[i]) << " ends with a damaged record" << endl;
+		m_segment = segments[i] + 1;
+	}
+	delete painter;
+
+	m_discardedBefore = firstSegment;
+}
+
+/*
+ * Queues an update to be written to the current segment.
+ */
+void
+Journal::append(const PaintUpdate &update)
+{
+	string payload;
+	update.encode(payload);
+
+	string record;
+	appendVarint(record, (uint32_t)payload.length());
+	record += payload;
+	appendUInt32(record, crc32(0L, (const Bytef *)payload.data(), payload.length()));
+
+	m_mutex.lock();
+	if(m_chunks.empty() || m_chunks.back().segment != m_segment) {
+		m_chunks.push_back(Chunk());
+		m_chunks.back().segment = m_segment;
+		m_chunks.back().records = 0;
+	}
+	m_chunks.back().data += record;
+	++m_chunks.back().records;
+	++m_records;
+	m_bytes += record.length();
+	m_condition.signal();
+	m_mutex.unlock();
+}
+
+/*
+ * Starts a new segment for updates appended from now on, returning
+ * its number. The caller must make sure no updates are appended
+ * while it takes the snapshot of the canvas that goes with it.
+ */
+unsigned int
+Journal::startSegment()
+{
+	MutexLocker locker(&m_mutex);
+	return ++m_segment;
+}
+
+/*
+ * Deletes the segments before the given one, once
+ * a saved canvas holds all of the updates in them.
+ */
+void
+Journal::discardBefore(unsigned int segment)
+{
+	m_mutex.lock();
+	if(segment <= m_discardedBefore) {
+		m_mutex.unlock();
+		return;
+	}
+	m_discardedBefore = segment;
+	m_mutex.unlock();
+
+	vector <unsigned int> segments;
+	getSegments(segments);
+	for(size_t i = 0; i < segments.size() && segments[i] < segment; ++i)
+		unlink(getSegmentFilename(segments[i]).c_str());
+}
+
+/*
+ * Opens a segment to append to. A segment opened again after a failure
+ * is first cut back to what was last synced, in case that couldn't be
+ * done when the failure happened.
+ */
+bool
+Journal::openSegment(unsigned int segment)
+{
+	string filename = getSegmentFilename(segment);
+	m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if(m_fd == -1)
+		return false;
+
+	if(segment == m_fdSegment && m_fdLength != -1) {
+		if(ftruncate(m_fd, m_fdLength) != 0) {
+			close(m_fd);
+			m_fd = -1;
+			return false;
+		}
+	} else {
+		struct stat st;
+		if(fstat(m_fd, &st) != 0) {
+			close(m_fd);
+			m_fd = -1;
+			return false;
+		}
+		m_fdSegment = segment;
+		m_fdLength = st.st_size;
+	}
+
+	syncDirectoryOf(filename);
+	return true;
+}
+
+bool
+Journal::writeChunk(const Chunk &chunk)
+{
+	const char *p = chunk.data.data();
+	size_t remaining = chunk.data.length();
+	while(remaining > 0) {
+		ssize_t written = ::write(m_fd, p, remaining);
+		if(written == -1) {
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		p += written;
+		remaining -= written;
+	}
+
+	return true;
+}
+
+/*
+ * Cuts the open segment back to what was last synced, so that a torn
+ * record is never left in front of the ones written after it, and
+ * closes it.
+ */
+void
+Journal::rollBack()
+{
+	if(m_fd == -1)
+		return;
+
+	// if it can't be cut back now, it is when it's reopened
+	if(ftruncate(m_fd, m_fdLength) == 0)
+		fdatasync(m_fd);
+	close(m_fd);
+	m_fd = -1;
+}
+
+/*
+ * Writes chunks of records to their segments and syncs them. Returns
+ * how many of the chunks, from the first, are known to be on disk.
+ */
+size_t
+Journal::write(const vector <Chunk> &chunks)
+{
+	size_t synced = 0;
+	for(size_t i = 0; i < chunks.size(); ++i) {
+		const Chunk &chunk = chunks[i];
+
+		// move on to the chunk's segment, making sure
+		// everything in the last one is on disk first
+		if(m_fd == -1 || chunk.segment != m_fdSegment) {
+			if(m_fd != -1) {
+				if(fdatasync(m_fd) != 0) {
+					rollBack();
+					return synced;
+				}
+				close(m_fd);
+				m_fd = -1;
+			}
+			synced = i;
+
+			if(!openSegment(chunk.segment))
+				return synced;
+		}
+
+		if(!writeChunk(chunk)) {
+			rollBack();
+			return synced;
+		}
+	}
+
+	struct stat st;
+	if(m_fd == -1 || fdatasync(m_fd) != 0 || fstat(m_fd, &st) != 0) {
+		rollBack();
+		return synced;
+	}
+	m_fdLength = st.st_size;
+
+	return chunks.size();
+}
+
+void
+Journal::run()
+{
+	m_mutex.lock();
+	while(true) {
+		while(m_chunks.empty() && !m_stopping)
+			m_condition.wait(&m_mutex);
+		if(m_chunks.empty())
+			break;
+
+		// take everything appended so far; whatever is
+		// appended while it's written goes with the next sync
+		vector <Chunk> chunks;
+		chunks.swap(m_chunks);
+
+		m_mutex.unlock();
+		size_t written = write(chunks);
+		m_mutex.lock();
+
+		if(written == chunks.size()) {
+			++m_commits;
+			continue;
+		}
+		++m_failures;
+
+		// put back what wasn't written, ahead of what has been
+		// appended since, unless a saved canvas already holds it;
+		// once the journal is stopping it's given up on
+		vector <Chunk> unwritten;
+		for(size_t i = written; i < chunks.size(); ++i) {
+			if(m_stopping)
+				m_dropped += chunks[i].records;
+			else if(chunks[i].segment >= m_discardedBefore)
+				unwritten.push_back(chunks[i]);
+		}
+		m_chunks.insert(m_chunks.begin(), unwritten.begin(), unwritten.end());
+
+		if(!m_stopping) {
+			m_mutex.unlock();
+			usleep(RETRY_DELAY * 1000);
+			m_mutex.lock();
+		}
+	}
+
+	if(m_dropped > 0)
+		cout << "Journal::run(): " << m_dropped << " records for " << m_filename << " couldn't be written" << endl;
+	m_mutex.unlock();
+}
+
+/*
+ * Writes out everything appended and stops the background thread.
+ */
+void
+Journal::stop()
+{
+	m_mutex.lock();
+	m_stopping = true;
+	m_condition.signal();
+	m_mutex.unlock();
+
+	join();
+
+	if(m_fd != -1) {
+		close(m_fd);
+		m_fd = -1;
+	}
+}
+
+unsigned long
+Journal::getRecords()
+{
+	MutexLocker locker(&m_mutex);
+	return m_records;
+}
+
+unsigned long
+Journal::getBytes()
+{
+	MutexLocker locker(&m_mutex);
+	return m_bytes;
+}
+
+unsigned long
+Journal::getCommits()
+{
+	MutexLocker locker(&m_mutex);
+	return m_commits;
+}
+
+unsigned long
+Journal::getFailures()
+{
+	MutexLocker locker(&m_mutex);
+	return m_failures;
+}
+
+unsigned long
+Journal::getDropped()
+{
+	MutexLocker locker(&m_mutex);
+	return m_dropped;
+}
+
+unsigned int
+Journal::getReplayed()
+{
+	MutexLocker locker(&m_mutex);
+	return m_replayed;
+}
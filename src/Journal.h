@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "Image.h"
+#include "Painter.h"
+#include "Thread.h"
+#include "UpdateLog.h"
+
+/*
+ * An append-only log of the updates drawn on a canvas, so that strokes
+ * drawn since the canvas was last saved survive a crash. The journal
+ * is kept in numbered segment files next to the canvas. Each record is
+ * the length of an update's binary form as a varint, the update itself
+ * and a CRC-32 of it; replay stops at the first damaged record, which
+ * can only be one torn by the crash.
+ *
+ * Records are written and synced by a background thread. Everything
+ * appended while a sync is under way is written and synced together
+ * with the next one, so a burst of updates costs a handful of syncs.
+ * If a write or sync fails, the segment is cut back to what was last
+ * synced and the records are written again a little later.
+ *
+ * Saving the canvas starts a new segment, and the number of the new
+ * segment is stored in the saved file. Once the file is written, the
+ * segments before it are no longer needed, and at load only the
+ * segments from it onwards are replayed.
+ */
+class Journal : public Thread
+{
+	private:
+		class Chunk
+		{
+			public:
+				unsigned int segment;
+				unsigned int records;
+				std::string data;
+		};
+
+		std::string m_filename;
+
+		Mutex m_mutex;
+		Condition m_condition;
+		bool m_stopping;
+		std::vector <Chunk> m_chunks;
+		unsigned int m_segment;
+		unsigned int m_discardedBefore;
+
+		// only used by the writing thread; the length is how much
+		// of the open segment is known to be synced
+		int m_fd;
+		unsigned int m_fdSegment;
+		off_t m_fdLength;
+
+		unsigned long m_records;
+		unsigned long m_bytes;
+		unsigned long m_commits;
+		unsigned long m_failures;
+		unsigned long m_dropped;
+		unsigned int m_replayed;
+
+		std::string getSegmentFilename(unsigned int segment) const;
+		void getSegments(std::vector <unsigned int> &segments) const;
+		bool replaySegment(unsigned int segment, Image *image, Painter *painter);
+		bool openSegment(unsigned int segment);
+		bool writeChunk(const Chunk &chunk);
+		void rollBack();
+		size_t write(const std::vector <Chunk> &chunks);
+
+	protected:
+		void run();
+
+	public:
+		Journal(const std::string &filename);
+		virtual ~Journal();
+
+		void open(unsigned int firstSegment, Image *image);
+		void append(const PaintUpdate &update);
+		unsigned int startSegment();
+		void discardBefore(unsigned int segment);
+		void stop();
+
+		unsigned long getRecords();
+		unsigned long getBytes();
+		unsigned long getCommits();
+		unsigned long getFailures();
+		unsigned long getDropped();
+		unsigned int getReplayed();
+};
+
+#endif /* __JOURNAL_H__ */
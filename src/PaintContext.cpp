@@ -31,65 +31,137 @@
 
 using namespace std;
 
+// what a connection has been marked pending for
+static const int PENDING_UPDATES = 1;
+static const int PENDING_KEEPALIVE = 2;
+
 PaintContext::PaintContext(const HttpRequest *request,
                            HttpResponse *response,
-                           PaintResponder *responder)
+                           PaintResponder *responder, Room *room)
 {
 	m_responder = responder;
+	m_room = room;
+	m_response = response;
 
 	m_userId = String::toInt(request->getQueryStringValue("u"));
 	m_userLastUpdateId = String::toInt(request->getQueryStringValue("i"));
-	m_lastKeepaliveTime = getMilliseconds();
+	m_binary = (request->getQueryStringValue("f") == "b");
+
+	// update ids count from when the room was loaded, so an id from
+	// another epoch says nothing about what the client's canvas holds
+	if(request->getQueryStringValue("e") != room->getEpoch())
+		m_userLastUpdateId = -1;
 
 	m_lastUserCount = 0;
-	m_responder->incrementUserCount();
+	m_sentSinceKeepalive = true;
+	m_pending = 0;
 
 	response->setStatus(200, "OK");
 	response->setContentType("text/plain");
+	response->setHeaderValue("X-Canvas-Epoch", room->getEpoch());
 	string tmp = "hi:";
 	for(int i = 0; i < 2048; ++i)
 		tmp += "z";
 	response->sendString(tmp + "\n");
-	continueResponse(request, response);
+
+	// updates and user count changes mark the connection pending from
+	// now on; whatever it has missed so far is sent right away
+	m_room->subscribe(this);
+	__sync_fetch_and_and(&m_pending, 0);
+	sendUpdates();
 }
 
 PaintContext::~PaintContext()
 {
-	m_responder->decrementUserCount();
+	// the room was pinned for this connection when it was looked up
+	m_room->unsubscribe(this);
+	m_room->unpin();
 }
 
-ResponderContext *
-PaintContext::continueResponse(const HttpRequest * /*request*/,
-                               HttpResponse *response)
+/*
+ * Called by the room, from any thread, when there are new updates or
+ * the user count has changed. Nothing is sent here; the connection
+ * sends them itself when it next wakes up.
+ */
+void
+PaintContext::markPending()
 {
-	string updates = m_responder->getUpdates(m_userId, m_userLastUpdateId);
+	__sync_fetch_and_or(&m_pending, PENDING_UPDATES);
+}
+
+/*
+ * Called by the room from the sweep each KEEPALIVE_INTERVAL, so every
+ * connection shares the one timer. As with updates, the keepalive is
+ * sent when the connection next wakes up.
+ */
+void
+PaintContext::markKeepalive()
+{
+	__sync_fetch_and_or(&m_pending, PENDING_KEEPALIVE);
+}
+
+/*
+ * Sends the updates made since the last ones sent, along with the
+ * user count if it has changed.
+ */
+void
+PaintContext::sendUpdates()
+{
+	m_userLastUpdateId = m_room->getUpdates(m_userId, m_userLastUpdateId, m_binary, m_frames);
+	bool sent = false;
 
 	// send the current user count along with any updates
-	int userCount = m_responder->getUserCount();
+	int userCount = m_room->getUserCount();
 	if(userCount != m_lastUserCount) {
 		m_lastUserCount = userCount;
-		updates = string("uo:") + String::fromInt(userCount) + '\n' + updates;
+		m_response->sendString(string("uo:") + String::fromInt(userCount) + '\n');
+		sent = true;
 	}
 
-	if(updates.length() != 0) {
-		m_lastKeepaliveTime = getMilliseconds();
-		response->sendString(updates);
-	} else {
-		// send a keepalive message if no data
-		// has been sent for a while
-		long time = getMilliseconds();
-		if(time - m_lastKeepaliveTime >= 15000) {
-			m_lastKeepaliveTime = time;
-			response->sendString("hi:\n");
-		}
+	// the frames are shared by all connections and sent as they are
+	for(unsigned int i = 0; i < m_frames.size(); ++i) {
+		m_response->sendString(m_frames[i].getString());
+		sent = true;
 	}
+	m_frames.clear();
+
+	if(sent)
+		m_sentSinceKeepalive = true;
+}
+
+/*
+ * Sends a keepalive if nothing has been sent on this connection since
+ * the last keepalive tick.
+ */
+void
+PaintContext::sendKeepalive()
+{
+	if(!m_sentSinceKeepalive)
+		m_response->sendString("hi:\n");
+
+	m_sentSinceKeepalive = false;
+}
+
+ResponderContext *
+PaintContext::continueResponse(const HttpRequest * /*request*/,
+                               HttpResponse * /*response*/)
+{
+	// the room isn't polled; only a connection it has marked
+	// pending looks for updates or sends a keepalive
+	int pending = __sync_fetch_and_and(&m_pending, 0);
+	if(pending & PENDING_UPDATES)
+		sendUpdates();
+	if(pending & PENDING_KEEPALIVE)
+		sendKeepalive();
 
-	m_userLastUpdateId = m_responder->getUpdateId();
+	// the shared sweep runs once per SWEEP_INTERVAL however many
+	// connections wake up
+	m_responder->sweep();
 	return this;
 }
 
 long
 PaintContext::getResponseInterval() const
 {
-	return 50;
+	return PaintResponder::PUSH_INTERVAL;
 }
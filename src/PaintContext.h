@@ -26,23 +26,51 @@
 #ifndef __PAINTCONTEXT_H__
 #define __PAINTCONTEXT_H__
 
+#include <vector>
 #include <xviweb/Responder.h>
+#include "SharedBuffer.h"
 
 class PaintResponder;
+class Room;
 
+/*
+ * A GetUpdates connection. The connection subscribes to its room,
+ * which marks it pending when there are new updates for it, instead
+ * of each connection polling the room for them. Everything is sent
+ * from the server's own thread when the connection next wakes up.
+ */
 class PaintContext : public ResponderContext
 {
 	private:
 		PaintResponder *m_responder;
+		Room *m_room;
+		HttpResponse *m_response;
 		int m_userId;
 		int m_userLastUpdateId;
-		long m_lastKeepaliveTime;
 		int m_lastUserCount;
 
+		// whether anything has been sent since the last keepalive
+		// tick, so only quiet connections get a keepalive
+		bool m_sentSinceKeepalive;
+
+		// whether the client asked for updates in binary
+		bool m_binary;
+		std::vector <SharedBuffer> m_frames;
+
+		// set by the room when there's anything new to send or a
+		// keepalive is due
+		volatile int m_pending;
+
+		void sendUpdates();
+		void sendKeepalive();
+
 	public:
-		PaintContext(const HttpRequest *request, HttpResponse *response, PaintResponder *responder);
+		PaintContext(const HttpRequest *request, HttpResponse *response, PaintResponder *responder, Room *room);
 		virtual ~PaintContext();
 
+		void markPending();
+		void markKeepalive();
+
 		ResponderContext *continueResponse(const HttpRequest *request, HttpResponse *response);
 		long getResponseInterval() const;
 };
@@ -24,149 +24,304 @@
  */
 
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
 #include <xviweb/String.h>
 #include "PaintResponder.h"
 #include "PaintContext.h"
+#include "Encoding.h"
+#include "Painter.h"
 #include "Exception.h"
 #include "Util.h"
 
-const char *CANVAS_PATH = "Canvas.png";
+// rooms without users are evicted after this many milliseconds without
+// activity, and at the next sweep if more than this many rooms are loaded
+const long ROOM_IDLE_TIME = 300000;
+const unsigned int MAX_LOADED_ROOMS = 64;
+const size_t MAX_ROOM_NAME_LENGTH = 64;
+
+// strokes are simplified to within this fraction of the brush
+// size; off by default, and overridden by XVIPAINT_SIMPLIFY
+const float SIMPLIFY_TOLERANCE = 0.0f;
+
+// batches of updates are drawn with this many threads, a tile at a
+// time; one draws each update in turn, and XVIPAINT_DRAW_THREADS
+// overrides it
+const unsigned int DRAW_THREADS = 1;
+
+// canvas PNGs are compressed at this zlib level, with this filter and
+// with this many threads; a low level without filtering makes for
+// quick saves, a high one for small files; XVIPAINT_PNG_LEVEL,
+// XVIPAINT_PNG_FILTER and XVIPAINT_PNG_THREADS override them
+const int PNG_LEVEL = 6;
+const PngEncoder::Filter PNG_FILTER = PngEncoder::FILTER_ADAPTIVE;
+const unsigned int PNG_THREADS = 1;
 
 using namespace std;
 
 PaintResponder::PaintResponder()
 {
-	m_updateId = 0;
-	m_userCount = 0;
+	m_simplifyTolerance = SIMPLIFY_TOLERANCE;
+	const char *simplify = getenv("XVIPAINT_SIMPLIFY");
+	if(simplify != NULL)
+		setSimplifyTolerance((float)atof(simplify));
+	m_pointsReceived = 0;
+	m_pointsKept = 0;
+	m_nextSweepTime = 0;
+	m_nextKeepaliveTime = 0;
 
-	m_painter = new Painter();
-	try {
-		m_image = Image::load(CANVAS_PATH);
-	} catch(Exception ex) {
-		// create a new image if one doesn't already exist
-		m_image = new Image(800, 450, 3);
-		m_image->save(CANVAS_PATH);
-	}
-	m_lastSaveTime = getMilliseconds();
-}
+	unsigned int drawThreads = DRAW_THREADS;
+	const char *threads = getenv("XVIPAINT_DRAW_THREADS");
+	if(threads != NULL && atoi(threads) > 0)
+		drawThreads = (unsigned int)atoi(threads);
 
-PaintResponder::~PaintResponder()
-{
-	delete m_painter;
-	m_image->save(CANVAS_PATH);
-	delete m_image;
+	m_renderer = new RenderThread(drawThreads);
+	m_renderer->start();
+
+	m_pngSettings.level = PNG_LEVEL;
+	m_pngSettings.filter = PNG_FILTER;
+	m_pngSettings.threads = PNG_THREADS;
+	const char *level = getenv("XVIPAINT_PNG_LEVEL");
+	if(level != NULL && atoi(level) >= 0 && atoi(level) <= 9)
+		m_pngSettings.level = atoi(level);
+	const char *filter = getenv("XVIPAINT_PNG_FILTER");
+	if(filter != NULL && !PngEncoder::parseFilter(filter, &m_pngSettings.filter))
+		cout << "Unknown PNG filter " << filter << "; using the default" << endl;
+	threads = getenv("XVIPAINT_PNG_THREADS");
+	if(threads != NULL && atoi(threads) > 0)
+		m_pngSettings.threads = (unsigned int)atoi(threads);
+
+	m_rooms = new RoomTable(m_pngSettings, MAX_LOADED_ROOMS, ROOM_IDLE_TIME);
 }
 
-static bool
-validateLines(const string &s)
+PaintResponder::~PaintResponder()
 {
-	vector <string> lines = String::split(s, ";");
-	for(unsigned int i = 0; i < lines.size(); ++i) {
-		// invalid if the number of coordinates
-		// given does not equal 4
-		vector <string> coords = String::split(lines[i], ",");
-		if(coords.size() != 4)
-			return false;
-
-		for(unsigned int j = 0; j < coords.size(); ++j) {
-			for(unsigned int k = 0; k < coords[j].length(); ++k) {
-				// invalid if any coordinate contains non-digits
-				char c = coords[j][k];
-				if(c < '0' || c > '9')
-					return false;
-			}
-		}
-	}
+	// draw whatever is still queued
+	m_renderer->stop();
+	delete m_renderer;
 
-	return true;
+	// write out every loaded room
+	delete m_rooms;
 }
 
-void
-PaintResponder::updateImage()
+/*
+ * Returns the room named by the request's "r" parameter, loading it if
+ * it isn't loaded, or NULL if the name isn't valid. Room names are up
+ * to MAX_ROOM_NAME_LENGTH letters, digits, dashes and underscores; the
+ * empty name is the default room. The room is returned pinned, so it
+ * isn't evicted until the caller unpins it.
+ */
+Room *
+PaintResponder::getRoom(const HttpRequest *request)
 {
-	// if the image was last updated more than 15 seconds ago, update it
-	long time = getMilliseconds();
-	if((time - m_lastSaveTime) > 15000) {
-		m_image->save(CANVAS_PATH);
-		m_lastSaveTime = time;
-
-		// delete all updates more than 10 seconds old
-		while(m_updates.size() != 0 && (time - m_updates[0].updateTime) > 10000)
-			m_updates.erase(m_updates.begin());
+	string name = request->getQueryStringValue("r");
+	if(name.length() > MAX_ROOM_NAME_LENGTH)
+		return NULL;
+	for(size_t i = 0; i < name.length(); ++i) {
+		char c = name[i];
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		     (c >= '0' && c <= '9') || c == '-' || c == '_'))
+			return NULL;
 	}
+
+	return m_rooms->getRoom(name);
 }
 
 void
-PaintResponder::handlePostUpdate(const HttpRequest *request,
+PaintResponder::handlePostUpdate(Room *room, const HttpRequest *request,
                                  HttpResponse *response)
 {
-	updateImage();
-
-	// get the update data and store it
+	// get the update data, posted either in binary as "b"
+	// or as separate text fields, and store it
 	PaintUpdate update;
-	update.lines = request->getPostDataValue("l");
-	if(validateLines(update.lines)) {
+	bool valid;
+	string binary = request->getPostDataValue("b");
+	if(!binary.empty()) {
+		string bytes;
+		valid = (decodeBase64(binary, bytes) && update.decode(bytes));
+	} else {
+		valid = update.stroke.parse(request->getPostDataValue("l"));
 		update.userId = String::toInt(request->getPostDataValue("u"));
 		update.brushSize = String::toInt(request->getPostDataValue("s"));
-		update.brushColor = request->getPostDataValue("c");
+		update.brushColor = Color(request->getPostDataValue("c"));
+	}
 
-		update.updateTime = getMilliseconds();
-		update.updateId = ++m_updateId;
-		m_updates.push_back(update);
+	// an update that couldn't be drawn is turned away here, before
+	// it's logged, journaled or sent out to anyone
+	if(valid && !Painter::isValidBrushSize(update.brushSize)) {
+		response->sendResponse(400, "Bad Request", "text/plain", "");
+		return;
+	}
 
-		m_painter->processUpdate(m_image, update.brushSize, Color(update.brushColor), update.lines);
+	if(valid) {
+		// drop points that make no visible difference at this brush
+		// size before the stroke is stored, drawn and sent out
+		__sync_add_and_fetch(&m_pointsReceived, update.stroke.getPointCount());
+		if(m_simplifyTolerance > 0.0f)
+			update.stroke.simplify(m_simplifyTolerance * update.brushSize);
+		__sync_add_and_fetch(&m_pointsKept, update.stroke.getPointCount());
+
+		// the update is drawn and sent out by the render thread
+		if(!m_renderer->queue(room, update)) {
+			response->sendResponse(503, "Service Unavailable", "text/plain", "");
+			return;
+		}
 	}
 
 	response->sendResponse(200, "OK", "text/plain", "");
 }
 
-int
-PaintResponder::getUpdateId() const
+void
+PaintResponder::handleGetCanvas(Room *room, const HttpRequest *request,
+                                HttpResponse *response)
+{
+	string tag;
+	int updateId;
+	SharedBuffer png = room->getCanvasPng(tag, &updateId);
+
+	// the canvas holds every update up to updateId, which
+	// tells the client where to resume getting updates
+	response->setHeaderValue("ETag", tag);
+	response->setHeaderValue("Cache-Control", "no-cache");
+	response->setHeaderValue("X-Update-Id", String::fromInt(updateId));
+	response->setHeaderValue("X-Canvas-Epoch", room->getEpoch());
+
+	if(request->getHeaderValue("If-None-Match") == tag)
+		response->sendResponse(304, "Not Modified", "image/png", "");
+	else
+		response->sendResponse(200, "OK", "image/png", png.getString());
+}
+
+/*
+ * Sends what a client needs to bring its saved copy of the canvas up to
+ * date: the tiles changed since the epoch ("e") and update id ("v") the
+ * copy is from, or the whole canvas if that's smaller.
+ */
+void
+PaintResponder::handleGetTiles(Room *room, const HttpRequest *request,
+                               HttpResponse *response)
 {
-	return m_updateId;
+	vector <SharedBuffer> frames;
+	int updateId = room->getTiles(request->getQueryStringValue("e"),
+	                              String::toInt(request->getQueryStringValue("v")), frames);
+
+	string body;
+	for(size_t i = 0; i < frames.size(); ++i)
+		body += frames[i].getString();
+
+	response->setHeaderValue("Cache-Control", "no-cache");
+	response->setHeaderValue("X-Update-Id", String::fromInt(updateId));
+	response->setHeaderValue("X-Canvas-Epoch", room->getEpoch());
+	response->sendResponse(200, "OK", "text/plain", body);
 }
 
-string
-PaintResponder::getUpdates(int userId, int userLastUpdateId)
+void
+PaintResponder::handleGetStats(Room *room, const HttpRequest * /*request*/,
+                               HttpResponse *response)
 {
-	updateImage();
-
-	// loop through updates and add the ones
-	// not made by this user to the response
-	string response;
-	for(unsigned int i = 0; i < m_updates.size(); ++i) {
-		if(m_updates[i].userId == userId)
-			continue;
-
-		if(m_updates[i].updateId <= userLastUpdateId)
-			continue;
-
-		response += String::fromInt(m_updates[i].updateId);
-		response += " " + String::fromInt(m_updates[i].brushSize);
-		response += " " + m_updates[i].brushColor;
-		response += " " + m_updates[i].lines;
-		response += "\n";
-	}
+	CanvasSaver *saver = room->getSaver();
 
-	return response;
+	string stats;
+	stats += "rooms " + String::fromInt(m_rooms->getRoomCount()) + "\n";
+	stats += "users " + String::fromInt(room->getUserCount()) + "\n";
+	stats += "updateId " + String::fromInt(room->getUpdateId()) + "\n";
+	stats += "drawThreads " + String::fromInt((int)m_renderer->getDrawThreadCount()) + "\n";
+	stats += "pngLevel " + String::fromInt(m_pngSettings.level) + "\n";
+	stats += "pngThreads " + String::fromInt((int)m_pngSettings.threads) + "\n";
+	stats += "savesInFlight " + String::fromInt(saver->getSavesInFlight()) + "\n";
+	stats += "savesCompleted " + String::fromInt(saver->getSavesCompleted()) + "\n";
+	stats += "savesSkipped " + String::fromInt(saver->getSavesSkipped()) + "\n";
+	stats += "savesFailed " + String::fromInt(saver->getSavesFailed()) + "\n";
+
+	Journal *journal = room->getJournal();
+	char buf[256];
+	snprintf(buf, sizeof(buf), "journalRecords %lu\njournalBytes %lu\njournalCommits %lu\njournalFailures %lu\njournalDropped %lu\njournalReplayed %u\n",
+	         journal->getRecords(), journal->getBytes(), journal->getCommits(), journal->getFailures(),
+	         journal->getDropped(), journal->getReplayed());
+	stats += buf;
+	snprintf(buf, sizeof(buf), "tileCatchUps %lu\ncanvasCatchUps %lu\ncatchUpTiles %lu\n",
+	         room->getTileCatchUps(), room->getCanvasCatchUps(), room->getCatchUpTiles());
+	stats += buf;
+
+	// how much of the canvas PNG was compressed again rather than reused
+	const PngEncoder *canvasEncoder = room->getCanvasEncoder();
+	snprintf(buf, sizeof(buf), "canvasBandsEncoded %lu\ncanvasBandsReused %lu\n",
+	         canvasEncoder->getBandsEncoded(), canvasEncoder->getBandsReused());
+	stats += buf;
+
+	unsigned long pointsReceived = __sync_fetch_and_add((unsigned long *)&m_pointsReceived, 0);
+	unsigned long pointsKept = __sync_fetch_and_add((unsigned long *)&m_pointsKept, 0);
+
+	snprintf(buf, sizeof(buf), "simplifyTolerance %g\npointsReceived %lu\npointsKept %lu\npointsKeptRatio %.3f\n",
+	         m_simplifyTolerance, pointsReceived, pointsKept,
+	         (pointsReceived == 0) ? 1.0 : (double)pointsKept / pointsReceived);
+	stats += buf;
+
+	// where the time goes between posting and publishing an update
+	unsigned long rendered = m_renderer->getUpdatesRendered();
+	unsigned long batches = m_renderer->getBatches();
+	snprintf(buf, sizeof(buf), "queueDepth %d\nqueueDepthMax %d\nupdatesQueued %lu\nupdatesRendered %lu\nbatches %lu\n",
+	         m_renderer->getDepth(), m_renderer->getMaxDepth(), m_renderer->getUpdatesQueued(), rendered, batches);
+	stats += buf;
+	snprintf(buf, sizeof(buf), "queueWaitAvgUs %.1f\nrenderAvgUs %.1f\npublishAvgUs %.1f\n",
+	         (rendered == 0) ? 0.0 : (double)m_renderer->getQueueTime() / rendered,
+	         (rendered == 0) ? 0.0 : (double)m_renderer->getRenderTime() / rendered,
+	         (batches == 0) ? 0.0 : (double)m_renderer->getPublishTime() / batches);
+	stats += buf;
+
+	response->sendResponse(200, "OK", "text/plain", stats);
 }
 
-int
-PaintResponder::getUserCount() const
+float
+PaintResponder::getSimplifyTolerance() const
 {
-	return m_userCount;
+	return m_simplifyTolerance;
 }
 
+/*
+ * Sets the distance, as a fraction of the brush size, that simplified
+ * strokes stay within. Zero or less turns simplification off. This
+ * should be set before requests are being handled.
+ */
 void
-PaintResponder::incrementUserCount()
+PaintResponder::setSimplifyTolerance(float tolerance)
 {
-	++m_userCount;
+	m_simplifyTolerance = (tolerance > 0.0f) ? tolerance : 0.0f;
 }
 
+/*
+ * Saves and expires updates in every loaded room, marks the quiet
+ * connections for a keepalive, and evicts idle rooms. Every connection
+ * calls this when it wakes up, but only the first call each
+ * SWEEP_INTERVAL does anything, so the work doesn't grow with the
+ * number of connections.
+ */
 void
-PaintResponder::decrementUserCount()
+PaintResponder::sweep()
 {
-	--m_userCount;
+	long time = getMilliseconds();
+	long nextSweepTime = __sync_fetch_and_add(&m_nextSweepTime, 0);
+	if(time < nextSweepTime || !__sync_bool_compare_and_swap(&m_nextSweepTime, nextSweepTime, time + SWEEP_INTERVAL))
+		return;
+
+	// the rooms are pinned rather than having their shards
+	// locked, since saving them can take a while
+	// only the caller that won the sweep gets here, so the
+	// keepalive time needs no locking of its own
+	bool keepalive = (time >= m_nextKeepaliveTime);
+	if(keepalive)
+		m_nextKeepaliveTime = time + KEEPALIVE_INTERVAL;
+
+	vector <Room *> rooms;
+	m_rooms->getPinnedRooms(rooms);
+	for(size_t i = 0; i < rooms.size(); ++i) {
+		rooms[i]->updateImage(time);
+		if(keepalive)
+			rooms[i]->markKeepalives();
+		rooms[i]->unpin();
+	}
+
+	m_rooms->evictRooms(time);
 }
 
 bool
@@ -179,13 +334,37 @@ ResponderContext *
 PaintResponder::respond(const HttpRequest *request, HttpResponse *response)
 {
 	string path = request->getPath();
-	if(path.find("/PostUpdate") != string::npos) {
-		handlePostUpdate(request, response);
-	} else if(path.find("/GetUpdates") != string::npos) {
-		return new PaintContext(request, response, this);
-	} else {
+	if(path.find("/PostUpdate") == string::npos && path.find("/GetUpdates") == string::npos &&
+	   path.find("/GetCanvas") == string::npos && path.find("/Tiles") == string::npos &&
+	   path.find("/GetStats") == string::npos) {
 		response->endResponse();
+		return NULL;
+	}
+
+	Room *room = getRoom(request);
+	if(room == NULL) {
+		response->sendResponse(404, "Not Found", "text/plain", "");
+		return NULL;
+	}
+
+	// connections keep the room pinned until they're closed
+	if(path.find("/GetUpdates") != string::npos)
+		return new PaintContext(request, response, this, room);
+
+	try {
+		if(path.find("/PostUpdate") != string::npos)
+			handlePostUpdate(room, request, response);
+		else if(path.find("/GetCanvas") != string::npos)
+			handleGetCanvas(room, request, response);
+		else if(path.find("/Tiles") != string::npos)
+			handleGetTiles(room, request, response);
+		else if(path.find("/GetStats") != string::npos)
+			handleGetStats(room, request, response);
+	} catch(Exception &ex) {
+		room->unpin();
+		throw;
 	}
+	room->unpin();
 
 	return NULL;
 }
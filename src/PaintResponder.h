@@ -27,44 +27,54 @@
 #define __PAINTRESPONDER_H__
 
 #include <string>
-#include <vector>
 #include <xviweb/Responder.h>
-#include "Painter.h"
-
-class PaintUpdate
-{
-	public:
-		int updateTime;
-		int updateId;
-		int userId;
-		int brushSize;
-		std::string brushColor;
-		std::string lines;
-};
+#include "RenderThread.h"
+#include "Room.h"
+#include "RoomTable.h"
 
 class PaintResponder : public Responder
 {
 	private:
-		int m_updateId;
-		std::vector <PaintUpdate> m_updates;
-		int m_userCount;
+		RoomTable *m_rooms;
+		RenderThread *m_renderer;
+
+		// how every room's canvas PNGs are compressed
+		PngEncoder::Settings m_pngSettings;
 
-		Painter *m_painter;
-		Image *m_image;
-		long m_lastSaveTime;
+		// posted strokes are simplified to within this fraction of
+		// the brush size, if it's above zero; the point counts before
+		// and after simplifying are kept for the stats
+		float m_simplifyTolerance;
+		volatile unsigned long m_pointsReceived;
+		volatile unsigned long m_pointsKept;
 
-		void updateImage();
-		void handlePostUpdate(const HttpRequest *request, HttpResponse *response);
+		// when the next sweep over the rooms, and the next
+		// keepalive tick within it, are due
+		volatile long m_nextSweepTime;
+		long m_nextKeepaliveTime;
+
+		Room *getRoom(const HttpRequest *request);
+
+		void handlePostUpdate(Room *room, const HttpRequest *request, HttpResponse *response);
+		void handleGetCanvas(Room *room, const HttpRequest *request, HttpResponse *response);
+		void handleGetTiles(Room *room, const HttpRequest *request, HttpResponse *response);
+		void handleGetStats(Room *room, const HttpRequest *request, HttpResponse *response);
 
 	public:
+		// milliseconds between keepalives to quiet connections,
+		// between sweeps over the loaded rooms, and between a
+		// connection's checks for pending updates
+		static const long KEEPALIVE_INTERVAL = 15000;
+		static const long SWEEP_INTERVAL = 1000;
+		static const long PUSH_INTERVAL = 50;
+
 		PaintResponder();
 		virtual ~PaintResponder();
-		std::string getUpdates(int userId, int userLastUpdateId);
-		int getUpdateId() const;
 
-		int getUserCount() const;
-		void incrementUserCount();
-		void decrementUserCount();
+		float getSimplifyTolerance() const;
+		void setSimplifyTolerance(float tolerance);
+
+		void sweep();
 
 		bool matchesRequest(const HttpRequest *request) const;
 		ResponderContext *respond(const HttpRequest *request, HttpResponse *response);
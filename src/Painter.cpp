@@ -26,6 +26,8 @@
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
+#include <climits>
+#include <cstring>
 #include "Exception.h"
 #include "Painter.h"
 
@@ -34,11 +36,15 @@ using namespace std;
 Painter::Painter()
 {
 	// create brushes
-	m_brush32 = Image::load("Images/Brush32.png");
-	m_brush16 = Image::load("Images/Brush16.png");
-	m_brush8 = Image::load("Images/Brush8.png");
-	m_brush4 = Image::load("Images/Brush4.png");
-	m_brush2 = Image::load("Images/Brush2.png");
+	m_brush32 = Brush::load("Images/Brush32.png");
+	m_brush16 = Brush::load("Images/Brush16.png");
+	m_brush8 = Brush::load("Images/Brush8.png");
+	m_brush4 = Brush::load("Images/Brush4.png");
+	m_brush2 = Brush::load("Images/Brush2.png");
+
+	m_blendRow = getBlendRowFunction();
+	m_sourceComponents = 0;
+	clearClip();
 }
 
 Painter::~Painter()
@@ -51,7 +57,13 @@ Painter::~Painter()
 	delete m_brush2;
 }
 
-Image *
+bool
+Painter::isValidBrushSize(int size)
+{
+	return (size == 2 || size == 4 || size == 8 || size == 16 || size == 32);
+}
+
+Brush *
 Painter::brushFromSize(int size)
 {
 	switch(size) {
@@ -71,61 +83,289 @@ Painter::brushFromSize(int size)
 }
 
 void
-Painter::drawDot(Image *image, unsigned int x, unsigned int y,
-                 const Color &color, int size)
+Painter::setSource(const Color &color, int components, unsigned int width)
 {
-	Image *brush = brushFromSize(size);
+	if(m_sourceColor.toUInt32() == color.toUInt32() &&
+	   m_sourceComponents == components && m_source.size() >= width * components)
+		return;
 
-	unsigned int brushWidth = brush->getWidth();
-	unsigned int brushHeight = brush->getHeight();
-	unsigned int imageWidth = image->getWidth();
-	unsigned int imageHeight = image->getHeight();
+	// lay out one source byte per destination byte; gray images
+	// take the red component, and alpha channels are always opaque
+	m_sourceColor = color;
+	m_sourceComponents = components;
+	m_source.resize(width * components);
+	for(unsigned int i = 0; i < width; ++i) {
+		uint8_t *p = &m_source[i * components];
+		switch(components) {
+			default:
+				break;
+			case 1:
+				p[0] = color.r;
+				break;
+			case 2:
+				p[0] = color.r;
+				p[1] = 255;
+				break;
+			case 3:
+				p[0] = color.r;
+				p[1] = color.g;
+				p[2] = color.b;
+				break;
+			case 4:
+				p[0] = color.r;
+				p[1] = color.g;
+				p[2] = color.b;
+				p[3] = 255;
+				break;
+		}
+	}
+}
 
-	x -= brushWidth / 2;
-	y -= brushHeight / 2;
+void
+Painter::coverSpan(int row, int x, const uint8_t *texels, int start, int end)
+{
+	uint8_t *coverage = &m_coverage[m_rowOffset[row]] - m_spanLeft[row] + x;
+	int filledStart = 1;
+	int filledEnd = 0;
+	if(m_filledLeft[row] <= m_filledRight[row]) {
+		filledStart = m_filledLeft[row] - x;
+		filledEnd = m_filledRight[row] - x;
+	}
 
-	for(unsigned int i = 0; i < brushHeight; ++i) {
-		unsigned int destY = y + i;
-		if(destY >= imageHeight)
+	// keep the highest coverage of any stamp, skipping
+	// pixels that are already known to be fully covered
+	for(int i = start; i <= end; ++i) {
+		if(i >= filledStart && i <= filledEnd) {
+			i = filledEnd;
 			continue;
+		}
 
-		for(unsigned int j = 0; j < brushWidth; ++j) {
-			unsigned int destX = x + j;
-			if(destX >= imageWidth)
-				continue;
+		if(texels[i] > coverage[i])
+			coverage[i] = texels[i];
+	}
+}
+
+void
+Painter::fillSpan(int row, int start, int end)
+{
+	uint8_t *coverage = &m_coverage[m_rowOffset[row]] - m_spanLeft[row];
+	int filledStart = m_filledLeft[row];
+	int filledEnd = m_filledRight[row];
+
+	if(filledStart > filledEnd) {
+		m_filledLeft[row] = start;
+		m_filledRight[row] = end;
+	} else if(start <= filledEnd + 1 && end >= filledStart - 1) {
+		// only fill what extends past the already filled run
+		if(start < filledStart) {
+			memset(coverage + start, 255, filledStart - start);
+			m_filledLeft[row] = start;
+		}
+		if(end > filledEnd) {
+			memset(coverage + filledEnd + 1, 255, end - filledEnd);
+			m_filledRight[row] = end;
+		}
+		return;
+	}
+
+	memset(coverage + start, 255, end - start + 1);
+}
+
+template <int N> void
+Painter::blendRows(ImageView<N> view, int top, int rows, uint8_t colorAlpha)
+{
+	int imageWidth = (int)view.getWidth();
+
+	for(int row = 0; row < rows; ++row) {
+		int start = max(m_spanLeft[row], max(m_clipLeft, 0));
+		int end = min(m_spanRight[row], min(m_clipRight, imageWidth - 1));
+		if(start > end)
+			continue;
 
-			Color tmp = brush->getPixel(j, i);
-			if(tmp.a != 0) {
-#if 0
-				Color color1 = image->getPixel(destX, destY);
-				Color color2 = tmp * color;
-
-				float a2 = color2.getFloatA();
-				float a1 = 1.0f - a2;
-				float r = color1.getFloatR() * a1 + color2.getFloatR() * a2;
-				float g = color1.getFloatG() * a1 + color2.getFloatG() * a2;
-				float b = color1.getFloatB() * a1 + color2.getFloatB() * a2;
-
-				image->setPixel(destX, destY, Color(r, g, b));
-#else
-				image->setPixel(destX, destY, color);
-#endif
+		// expand coverage to one alpha value per destination byte
+		const uint8_t *coverage = &m_coverage[m_rowOffset[row]] - m_spanLeft[row];
+		unsigned int length = (end - start + 1) * N;
+		m_alpha.resize(length);
+		uint8_t *alpha = &m_alpha[0];
+		for(int x = start; x <= end; ++x) {
+			uint8_t a = coverage[x];
+			if(colorAlpha != 255) {
+				unsigned int tmp = (unsigned int)a * colorAlpha + 128;
+				a = (uint8_t)((tmp + (tmp >> 8)) >> 8);
 			}
+
+			for(int c = 0; c < N; ++c)
+				alpha[(x - start) * N + c] = a;
+		}
+
+		// blend the row one contiguous span at a time
+		for(int x = start; x <= end;) {
+			unsigned int spanLength;
+			uint8_t *dest = view.getSpan(x, top + row, &spanLength);
+			if(spanLength > (unsigned int)(end - x + 1))
+				spanLength = end - x + 1;
+
+			m_blendRow(dest, &m_source[0], alpha + ((x - start) * N), spanLength * N);
+			x += spanLength;
 		}
 	}
 }
 
 void
-Painter::drawLine(Image *image, float x1, float y1, float x2, float y2,
-                  const Color &color, int size)
+Painter::fillStamps(Image *image, Brush *brush, const Color &color)
 {
-	float xdiff = (x2 - x1);
-	float ydiff = (y2 - y1);
+	int brushWidth = (int)brush->getWidth();
+	int brushHeight = (int)brush->getHeight();
+	int imageWidth = (int)image->getWidth();
+	int imageHeight = (int)image->getHeight();
+	int components = image->getNumComponents();
 
-	if(xdiff == 0.0f && ydiff == 0.0f) {
-		drawDot(image, (unsigned int)x1, (unsigned int)y1, color, size);
+	// get the rows covered by the stroke, clipped to the image
+	int top = INT_MAX;
+	int bottom = INT_MIN;
+	for(size_t i = 0; i < m_stamps.size(); i += 2) {
+		if(m_stamps[i + 1] < top)
+			top = m_stamps[i + 1];
+		if(m_stamps[i + 1] > bottom)
+			bottom = m_stamps[i + 1];
+	}
+	top -= brushHeight / 2;
+	bottom += brushHeight - (brushHeight / 2) - 1;
+	top = max(top, max(m_clipTop, 0));
+	bottom = min(bottom, min(m_clipBottom, imageHeight - 1));
+	if(top > bottom)
 		return;
+
+	// merge the span of every stamp row into the
+	// horizontal span covered on each image row
+	int rows = bottom - top + 1;
+	m_spanLeft.assign(rows, INT_MAX);
+	m_spanRight.assign(rows, INT_MIN);
+	for(size_t i = 0; i < m_stamps.size(); i += 2) {
+		int left = m_stamps[i] - (brushWidth / 2);
+		int stampTop = m_stamps[i + 1] - (brushHeight / 2);
+		if(left > m_clipRight || left + brushWidth <= m_clipLeft)
+			continue;
+
+		for(int j = 0; j < brushHeight; ++j) {
+			int row = stampTop + j - top;
+			if(row < 0 || row >= rows)
+				continue;
+
+			int start = brush->getSpanStart(j);
+			int end = brush->getSpanEnd(j);
+			if(start > end)
+				continue;
+
+			if(left + start < m_spanLeft[row])
+				m_spanLeft[row] = left + start;
+			if(left + end > m_spanRight[row])
+				m_spanRight[row] = left + end;
+		}
+	}
+
+	// lay out a coverage buffer holding each row's span
+	m_rowOffset.resize(rows);
+	size_t total = 0;
+	for(int row = 0; row < rows; ++row) {
+		m_rowOffset[row] = total;
+		if(m_spanLeft[row] <= m_spanRight[row])
+			total += m_spanRight[row] - m_spanLeft[row] + 1;
+	}
+	m_coverage.assign(total + 1, 0);
+	m_filledLeft.assign(rows, INT_MAX);
+	m_filledRight.assign(rows, INT_MIN);
+
+	// accumulate the coverage of every stamp; fully covered runs are
+	// filled directly, so only the soft edges are merged per texel
+	for(size_t i = 0; i < m_stamps.size(); i += 2) {
+		int left = m_stamps[i] - (brushWidth / 2);
+		int stampTop = m_stamps[i + 1] - (brushHeight / 2);
+		if(left > m_clipRight || left + brushWidth <= m_clipLeft)
+			continue;
+
+		for(int j = 0; j < brushHeight; ++j) {
+			int row = stampTop + j - top;
+			if(row < 0 || row >= rows)
+				continue;
+
+			int start = brush->getSpanStart(j);
+			int end = brush->getSpanEnd(j);
+			if(start > end)
+				continue;
+
+			const uint8_t *texels = brush->getCoverage(j);
+			int fullStart = brush->getFullStart(j);
+			int fullEnd = brush->getFullEnd(j);
+			if(fullStart > fullEnd) {
+				coverSpan(row, left, texels, start, end);
+			} else {
+				coverSpan(row, left, texels, start, fullStart - 1);
+				coverSpan(row, left, texels, fullEnd + 1, end);
+				fillSpan(row, left + fullStart, left + fullEnd);
+			}
+		}
+	}
+
+	// record the changed region of each row as its covered runs; a
+	// row's span also takes in any stretch no stamp reaches, such as
+	// between the arms of a stroke that bends back on itself
+	for(int row = 0; row < rows; ++row) {
+		int start = max(m_spanLeft[row], max(m_clipLeft, 0));
+		int end = min(m_spanRight[row], min(m_clipRight, imageWidth - 1));
+		const uint8_t *coverage = &m_coverage[m_rowOffset[row]] - m_spanLeft[row];
+		for(int x = start; x <= end; ++x) {
+			if(coverage[x] == 0)
+				continue;
+
+			int runStart = x;
+			while(x < end && coverage[x + 1] != 0)
+				++x;
+			image->markDirty(runStart, top + row, x - runStart + 1, 1);
+		}
+	}
+
+	// blend each covered pixel once
+	setSource(color, components, imageWidth);
+	switch(components) {
+		default:
+			throw Exception("Painter::fillStamps(): Invalid number of color components");
+			break;
+		case 1:
+			blendRows(ImageView<1>(image), top, rows, color.a);
+			break;
+		case 2:
+			blendRows(ImageView<2>(image), top, rows, color.a);
+			break;
+		case 3:
+			blendRows(ImageView<3>(image), top, rows, color.a);
+			break;
+		case 4:
+			blendRows(ImageView<4>(image), top, rows, color.a);
+			break;
 	}
+}
+
+void
+Painter::drawDot(Image *image, unsigned int x, unsigned int y,
+                 const Color &color, int size)
+{
+	m_stamps.clear();
+	m_stamps.push_back((int)x);
+	m_stamps.push_back((int)y);
+	fillStamps(image, brushFromSize(size), color);
+}
+
+/*
+ * Adds the positions the brush is stamped at along a line. If skipStart
+ * is set, the stamp at the start of the line is left out, as it has
+ * already been added as the end of the line before it.
+ */
+void
+Painter::addLineStamps(float x1, float y1, float x2, float y2, bool skipStart)
+{
+	float xdiff = (x2 - x1);
+	float ydiff = (y2 - y1);
 
 	if(fabs(xdiff) > fabs(ydiff)) {
 		float xmin, xmax;
@@ -140,11 +380,15 @@ Painter::drawLine(Image *image, float x1, float y1, float x2, float y2,
 			xmax = x1;
 		}
 
-		// draw line in terms of y slope
+		// step along the line in terms of y slope
 		float slope = ydiff / xdiff;
 		for(float x = xmin; x <= xmax; x += 1.0f) {
+			if(skipStart && x == x1)
+				continue;
+
 			float y = y1 + ((x - x1) * slope);
-			drawDot(image, (unsigned int)x, (unsigned int)y, color, size);
+			m_stamps.push_back((int)x);
+			m_stamps.push_back((int)y);
 		}
 	} else {
 		float ymin, ymax;
@@ -159,49 +403,120 @@ Painter::drawLine(Image *image, float x1, float y1, float x2, float y2,
 			ymax = y1;
 		}
 
-		// draw line in terms of x slope
-		float slope = xdiff / ydiff;
+		// step along the line in terms of x slope; a line of
+		// no length is a single stamp at its start
+		float slope = (ydiff == 0.0f) ? 0.0f : xdiff / ydiff;
 		for(float y = ymin; y <= ymax; y += 1.0f) {
+			if(skipStart && y == y1)
+				continue;
+
 			float x = x1 + ((y - y1) * slope);
-			drawDot(image, (unsigned int)x, (unsigned int)y, color, size);
+			m_stamps.push_back((int)x);
+			m_stamps.push_back((int)y);
 		}
 	}
 }
 
 void
-Painter::processLine(Image *image, int brushSize, const Color &brushColor,
-                     const string &line)
+Painter::drawLine(Image *image, float x1, float y1, float x2, float y2,
+                  const Color &color, int size)
+{
+	if(x2 == x1 && y2 == y1) {
+		drawDot(image, (unsigned int)x1, (unsigned int)y1, color, size);
+		return;
+	}
+
+	// collect the positions the brush would be stamped at along the
+	// line, then rasterize the whole stroke one scanline span at a time
+	m_stamps.clear();
+	addLineStamps(x1, y1, x2, y2, false);
+	fillStamps(image, brushFromSize(size), color);
+}
+
+/*
+ * Returns how many of the given points the first pass over a polyline
+ * takes in. Polylines that sprawl over more than MAX_POLYLINE_EXTENT
+ * pixels are drawn in passes, so the rows of a pass don't span large
+ * areas the stroke never touches; each pass after the first starts at
+ * the last point of the one before it.
+ */
+unsigned int
+Painter::getPassLength(const int16_t *points, unsigned int count)
+{
+	int left = points[0], right = points[0];
+	int top = points[1], bottom = points[1];
+
+	for(unsigned int i = 1; i < count; ++i) {
+		left = min(left, (int)points[i * 2]);
+		right = max(right, (int)points[i * 2]);
+		top = min(top, (int)points[(i * 2) + 1]);
+		bottom = max(bottom, (int)points[(i * 2) + 1]);
+		if(i > 1 && (right - left > MAX_POLYLINE_EXTENT || bottom - top > MAX_POLYLINE_EXTENT))
+			return i;
+	}
+
+	return count;
+}
+
+/*
+ * Draws connected lines through the given x, y pairs. The stamps of all
+ * of the lines in a pass are rasterized together, so each pixel is
+ * blended once per pass and the joints aren't stamped twice.
+ */
+void
+Painter::drawPolyline(Image *image, const int16_t *points, unsigned int count,
+                      const Color &color, int size)
 {
-	// parse coordinates
-	int coords[4];
-	char *s = (char *)line.c_str();
-	coords[0] = (int)strtol(s, &s, 10);
-	coords[1] = (int)strtol(s, &s, 10);
-	coords[2] = (int)strtol(s, &s, 10);
-	coords[3] = (int)strtol(s, NULL, 10);
+	Brush *brush = brushFromSize(size);
+
+	if(count == 1) {
+		m_stamps.clear();
+		addLineStamps(points[0], points[1], points[0], points[1], false);
+		fillStamps(image, brush, color);
+		return;
+	}
 
-	drawLine(image, (float)coords[0], (float)coords[1], (float)coords[2], (float)coords[3], brushColor, brushSize);
+	for(unsigned int start = 0; start + 1 < count;) {
+		unsigned int length = getPassLength(points + (start * 2), count - start);
 
+		m_stamps.clear();
+		for(unsigned int i = start + 1; i < start + length; ++i) {
+			const int16_t *p = points + ((i - 1) * 2);
+			addLineStamps(p[0], p[1], p[2], p[3], i > start + 1);
+		}
+		fillStamps(image, brush, color);
+
+		start += length - 1;
+	}
+}
+
+/*
+ * Limits drawing to the given rectangle, inclusive of its edges. Pixels
+ * inside it come out exactly as they would without the clip, so an
+ * image can be drawn a region at a time.
+ */
+void
+Painter::setClip(int left, int top, int right, int bottom)
+{
+	m_clipLeft = left;
+	m_clipTop = top;
+	m_clipRight = right;
+	m_clipBottom = bottom;
+}
+
+void
+Painter::clearClip()
+{
+	setClip(INT_MIN / 2, INT_MIN / 2, INT_MAX / 2, INT_MAX / 2);
 }
 
 void
 Painter::processUpdate(Image *image, int brushSize, const Color &brushColor,
-                       const string &lines)
-{
-	size_t index = 0;
-	size_t length;
-	do {
-		// get next line
-		length = lines.find(';', index);
-		if(length != string::npos)
-			length -= index;
-		string line = lines.substr(index, length);
-		index += length + 1;
-
-		for(size_t i = 0; i < line.length(); ++i) {
-			if(line[i] == ',')
-				line[i] = ' ';
-		}
-		processLine(image, brushSize, brushColor, line);
-	} while(length != string::npos);
+                       const Stroke &stroke)
+{
+	for(unsigned int i = 0; i < stroke.getPolylineCount(); ++i) {
+		unsigned int count;
+		const int16_t *points = stroke.getPolyline(i, &count);
+		drawPolyline(image, points, count, brushColor, brushSize);
+	}
 }
@@ -23,21 +23,58 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "Image.h"
+#ifndef __PAINTER_H__
+#define __PAINTER_H__
+
+#include <vector>
+#include "Blend.h"
+#include "Brush.h"
+#include "ImageView.h"
+#include "Stroke.h"
 
 class Painter
 {
 	private:
-		Image *m_brush32, *m_brush16, *m_brush8, *m_brush4, *m_brush2;
+		Brush *m_brush32, *m_brush16, *m_brush8, *m_brush4, *m_brush2;
+
+		BlendRowFunction m_blendRow;
+
+		std::vector <int> m_stamps;
+		std::vector <int> m_spanLeft, m_spanRight;
+		std::vector <int> m_filledLeft, m_filledRight;
+		std::vector <size_t> m_rowOffset;
+		std::vector <uint8_t> m_coverage;
+		std::vector <uint8_t> m_alpha;
+
+		Color m_sourceColor;
+		int m_sourceComponents;
+		std::vector <uint8_t> m_source;
 
-		Image *brushFromSize(int size);
+		// only pixels within the clip rectangle are drawn
+		int m_clipLeft, m_clipTop, m_clipRight, m_clipBottom;
+
+		Brush *brushFromSize(int size);
+		void setSource(const Color &color, int components, unsigned int width);
+		void coverSpan(int row, int x, const uint8_t *texels, int start, int end);
+		void fillSpan(int row, int start, int end);
+		template <int N> void blendRows(ImageView<N> view, int top, int rows, uint8_t colorAlpha);
+		void fillStamps(Image *image, Brush *brush, const Color &color);
+		void addLineStamps(float x1, float y1, float x2, float y2, bool skipStart);
 
 	public:
+		static const int MAX_POLYLINE_EXTENT = 256;
+
 		Painter();
 		virtual ~Painter();
 
 		void drawDot(Image *image, unsigned int x, unsigned int y, const Color &color, int size);
 		void drawLine(Image *image, float x1, float y1, float x2, float y2, const Color &color, int size);
-		void processLine(Image *image, int brushSize, const Color &brushColor, const std::string &line);
-		void processUpdate(Image *image, int brushSize, const Color &brushColor, const std::string &lines);
+		void drawPolyline(Image *image, const int16_t *points, unsigned int count, const Color &color, int size);
+		static unsigned int getPassLength(const int16_t *points, unsigned int count);
+		static bool isValidBrushSize(int size);
+		void setClip(int left, int top, int right, int bottom);
+		void clearClip();
+		void processUpdate(Image *image, int brushSize, const Color &brushColor, const Stroke &stroke);
 };
+
+#endif /* __PAINTER_H__ */
@@ -0,0 +1,525 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "Exception.h"
+#include "PngEncoder.h"
+
+using namespace std;
+
+static const uint8_t PNG_SIGNATURE[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+// an empty final block in fixed Huffman codes, which
+// ends the deflate stream after the last band
+static const uint8_t DEFLATE_END[2] = { 0x03, 0x00 };
+
+// the most a deflate stream can look back
+static const size_t DICTIONARY_SIZE = 32768;
+
+static const char *FILTER_NAMES[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+
+PngEncoder::Settings::Settings()
+{
+	level = 6;
+	filter = FILTER_ADAPTIVE;
+	threads = 1;
+}
+
+PngEncoder::Deflater::Deflater(const Settings &settings)
+{
+	memset(&stream, 0, sizeof(stream));
+
+	// raw deflate; the zlib header and checksum are added around
+	// the bands, since each band is compressed on its own
+	int strategy = (settings.filter == FILTER_NONE) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+	if(deflateInit2(&stream, settings.level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+		throw Exception("PngEncoder::Deflater::Deflater(): deflateInit2 failed");
+}
+
+PngEncoder::Deflater::~Deflater()
+{
+	deflateEnd(&stream);
+}
+
+PngEncoder::Worker::Worker(PngEncoder *encoder) : deflater(encoder->m_settings)
+{
+	m_encoder = encoder;
+}
+
+void
+PngEncoder::Worker::run()
+{
+	unsigned int generation = 0;
+
+	while(true) {
+		// wait for a new image to be handed out
+		m_encoder->m_mutex.lock();
+		while(m_encoder->m_generation == generation && !m_encoder->m_stopping)
+			m_encoder->m_startCondition.wait(&m_encoder->m_mutex);
+		generation = m_encoder->m_generation;
+		bool stopping = m_encoder->m_stopping;
+		m_encoder->m_mutex.unlock();
+
+		if(stopping)
+			break;
+
+		m_encoder->encodeBands(deflater);
+
+		if(__sync_sub_and_fetch(&m_encoder->m_running, 1) == 0) {
+			m_encoder->m_mutex.lock();
+			m_encoder->m_doneCondition.broadcast();
+			m_encoder->m_mutex.unlock();
+		}
+	}
+}
+
+PngEncoder::PngEncoder(const Settings &settings) : m_settings(settings), m_deflater(settings)
+{
+	if(m_settings.threads == 0)
+		m_settings.threads = 1;
+
+	m_width = 0;
+	m_height = 0;
+	m_colorComponents = 0;
+	m_serial = 0;
+
+	m_image = NULL;
+	m_nextBand = 0;
+	m_failed = 0;
+
+	m_bandsEncoded = 0;
+	m_bandsReused = 0;
+
+	m_generation = 0;
+	m_stopping = false;
+	m_running = 0;
+	for(unsigned int i = 1; i < m_settings.threads; ++i) {
+		Worker *worker = NULL;
+		try {
+			worker = new Worker(this);
+			worker->start();
+		} catch(Exception &ex) {
+			// make do with the threads there are
+			delete worker;
+			break;
+		}
+		m_workers.push_back(worker);
+	}
+}
+
+PngEncoder::~PngEncoder()
+{
+	m_mutex.lock();
+	m_stopping = true;
+	m_startCondition.broadcast();
+	m_mutex.unlock();
+
+	for(size_t i = 0; i < m_workers.size(); ++i) {
+		m_workers[i]->join();
+		delete m_workers[i];
+	}
+}
+
+static void
+appendUInt32(string &s, uLong value)
+{
+	s += (char)((value >> 24) & 0xff);
+	s += (char)((value >> 16) & 0xff);
+	s += (char)((value >> 8) & 0xff);
+	s += (char)(value & 0xff);
+}
+
+static void
+appendChunk(string &s, const char *type, const char *data, size_t length, uLong crc)
+{
+	appendUInt32(s, length);
+	s.append(type, 4);
+	s.append(data, length);
+	appendUInt32(s, crc);
+}
+
+static void
+appendChunk(string &s, const char *type, const string &data)
+{
+	uLong crc = crc32(0L, (const Bytef *)type, 4);
+	crc = crc32(crc, (const Bytef *)data.data(), data.length());
+	appendChunk(s, type, data.data(), data.length(), crc);
+}
+
+static inline int
+paethPredictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc)
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+/*
+ * Filters a row with one filter, writing the filter type and the
+ * filtered bytes to out, and returns the sum of the filtered bytes
+ * taken as signed, which is smaller the better the row compresses.
+ */
+static unsigned long
+applyFilter(int filter, const uint8_t *row, const uint8_t *prior, size_t length,
+            size_t bpp, uint8_t *out)
+{
+	*out++ = (uint8_t)filter;
+
+	// the first pixel has nothing to its left
+	size_t i;
+	switch(filter) {
+		case PngEncoder::FILTER_NONE:
+			memcpy(out, row, length);
+			break;
+		case PngEncoder::FILTER_SUB:
+			memcpy(out, row, bpp);
+			for(i = bpp; i < length; ++i)
+				out[i] = (uint8_t)(row[i] - row[i - bpp]);
+			break;
+		case PngEncoder::FILTER_UP:
+			for(i = 0; i < length; ++i)
+				out[i] = (uint8_t)(row[i] - prior[i]);
+			break;
+		case PngEncoder::FILTER_AVERAGE:
+			for(i = 0; i < bpp; ++i)
+				out[i] = (uint8_t)(row[i] - (prior[i] / 2));
+			for(; i < length; ++i)
+				out[i] = (uint8_t)(row[i] - ((row[i - bpp] + prior[i]) / 2));
+			break;
+		case PngEncoder::FILTER_PAETH:
+			for(i = 0; i < bpp; ++i)
+				out[i] = (uint8_t)(row[i] - prior[i]);
+			for(; i < length; ++i)
+				out[i] = (uint8_t)(row[i] - paethPredictor(row[i - bpp], prior[i], prior[i - bpp]));
+			break;
+	}
+
+	unsigned long sum = 0;
+	for(i = 0; i < length; ++i)
+		sum += (out[i] < 128) ? out[i] : 256 - out[i];
+
+	return sum;
+}
+
+/*
+ * Filters a row, writing the filter type and the filtered bytes to
+ * out. The adaptive filter picks whichever filter gives the smallest
+ * sum, as libpng does. candidate holds another length + 1 bytes.
+ */
+static void
+filterRow(PngEncoder::Filter filter, const uint8_t *row, const uint8_t *prior,
+          size_t length, size_t bpp, uint8_t *candidate, uint8_t *out)
+{
+	if(filter != PngEncoder::FILTER_ADAPTIVE) {
+		applyFilter(filter, row, prior, length, bpp, out);
+		return;
+	}
+
+	unsigned long bestSum = applyFilter(PngEncoder::FILTER_NONE, row, prior, length, bpp, out);
+	for(int f = PngEncoder::FILTER_SUB; f < PngEncoder::FILTER_ADAPTIVE; ++f) {
+		unsigned long sum = applyFilter(f, row, prior, length, bpp, candidate);
+		if(sum < bestSum) {
+			memcpy(out, candidate, length + 1);
+			bestSum = sum;
+		}
+	}
+}
+
+/*
+ * Returns true if a tile in the band has been drawn in
+ * since the last image was encoded.
+ */
+bool
+PngEncoder::isBandDirty(const Image *image, unsigned int band) const
+{
+	for(unsigned int column = 0; column < image->getTileColumns(); ++column) {
+		if(image->isTileDirty(column, band, m_serial))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Filters count rows of the image being encoded, starting at first,
+ * into the deflater's filtered buffer.
+ */
+void
+PngEncoder::filterRows(Deflater &deflater, unsigned int first, unsigned int count)
+{
+	size_t stride = m_width * m_colorComponents;
+
+	// the row above the top of the image is taken as all zeroes
+	deflater.raw.assign((stride * 3) + 1, 0);
+	uint8_t *row = &deflater.raw[0];
+	uint8_t *prior = row + stride;
+	uint8_t *candidate = prior + stride;
+	if(first > 0)
+		m_image->readRow(first - 1, prior);
+
+	deflater.filtered.resize((stride + 1) * count);
+	for(unsigned int i = 0; i < count; ++i) {
+		m_image->readRow(first + i, row);
+		filterRow(m_settings.filter, row, prior, stride, m_colorComponents,
+		          candidate, &deflater.filtered[(stride + 1) * i]);
+		swap(row, prior);
+	}
+}
+
+/*
+ * Filters and deflates the rows of a band, ending the compressed data
+ * on a full flush so that the next band can follow it. The compressor
+ * is primed with the end of the band above, which the decompressor
+ * will just have seen.
+ */
+void
+PngEncoder::encodeBand(Deflater &deflater, unsigned int band)
+{
+	Band &b = m_bands[band];
+	b.valid = false;
+
+	size_t stride = m_width * m_colorComponents;
+	unsigned int first = band * BAND_ROWS;
+	unsigned int rows = m_height - first;
+	if(rows > BAND_ROWS)
+		rows = BAND_ROWS;
+
+	if(deflateReset(&deflater.stream) != Z_OK)
+		throw Exception("PngEncoder::encodeBand(): deflateReset failed");
+
+	if(band > 0) {
+		unsigned int dictionaryRows = (DICTIONARY_SIZE + stride) / (stride + 1);
+		if(dictionaryRows > BAND_ROWS)
+			dictionaryRows = BAND_ROWS;
+		filterRows(deflater, first - dictionaryRows, dictionaryRows);
+
+		size_t length = min(deflater.filtered.size(), DICTIONARY_SIZE);
+		if(deflateSetDictionary(&deflater.stream, &deflater.filtered[deflater.filtered.size() - length], length) != Z_OK)
+			throw Exception("PngEncoder::encodeBand(): deflateSetDictionary failed");
+	}
+
+	filterRows(deflater, first, rows);
+	b.length = deflater.filtered.size();
+	b.adler = adler32(adler32(0L, NULL, 0), &deflater.filtered[0], b.length);
+
+	b.data.clear();
+	deflater.stream.next_in = &deflater.filtered[0];
+	deflater.stream.avail_in = b.length;
+	do {
+		Bytef buffer[16384];
+		deflater.stream.next_out = buffer;
+		deflater.stream.avail_out = sizeof(buffer);
+		if(deflate(&deflater.stream, Z_FULL_FLUSH) == Z_STREAM_ERROR)
+			throw Exception("PngEncoder::encodeBand(): deflate failed");
+		b.data.append((const char *)buffer, sizeof(buffer) - deflater.stream.avail_out);
+	} while(deflater.stream.avail_out == 0);
+
+	b.crc = crc32(crc32(0L, (const Bytef *)"IDAT", 4), (const Bytef *)b.data.data(), b.data.length());
+	b.valid = true;
+}
+
+/*
+ * Encodes bands until there are none left, taking turns with the
+ * other threads encoding.
+ */
+void
+PngEncoder::encodeBands(Deflater &deflater)
+{
+	while(!__sync_fetch_and_add(&m_failed, 0)) {
+		unsigned int i = __sync_fetch_and_add(&m_nextBand, 1);
+		if(i >= m_dirtyBands.size())
+			break;
+
+		try {
+			encodeBand(deflater, m_dirtyBands[i]);
+		} catch(Exception &ex) {
+			__sync_fetch_and_or(&m_failed, 1);
+		}
+	}
+}
+
+/*
+ * Encodes the image as a PNG, replacing the contents of data. Only
+ * the bands drawn in since the last image given, and the bands below
+ * them, are compressed again.
+ */
+void
+PngEncoder::encode(const Image *image, string &data)
+{
+	int colorType;
+	switch(image->getNumComponents()) {
+		default:
+			throw Exception("PngEncoder::encode(): Invalid number of color components");
+			break;
+		case 1:
+			colorType = 0;
+			break;
+		case 2:
+			colorType = 4;
+			break;
+		case 3:
+			colorType = 2;
+			break;
+		case 4:
+			colorType = 6;
+			break;
+	}
+
+	// start over if the image can't be a later snapshot of the one
+	// encoded last
+	if(image->getWidth() != m_width || image->getHeight() != m_height ||
+	   image->getNumComponents() != m_colorComponents ||
+	   (int)(image->getModificationSerial() - m_serial) < 0) {
+		m_width = image->getWidth();
+		m_height = image->getHeight();
+		m_colorComponents = image->getNumComponents();
+		m_bands.clear();
+		m_bands.resize((m_height + BAND_ROWS - 1) / BAND_ROWS);
+		for(size_t i = 0; i < m_bands.size(); ++i)
+			m_bands[i].valid = false;
+	}
+
+	// a band is primed with the one above it, and its first
+	// row filtered against it, so it changes along with it
+	m_dirtyBands.clear();
+	bool aboveChanged = false;
+	for(unsigned int i = 0; i < m_bands.size(); ++i) {
+		bool changed = (!m_bands[i].valid || isBandDirty(image, i));
+		if(changed || aboveChanged)
+			m_dirtyBands.push_back(i);
+		aboveChanged = changed;
+	}
+
+	m_image = image;
+	m_nextBand = 0;
+	m_failed = 0;
+
+	// a single band isn't worth waking the workers for
+	bool wake = (!m_workers.empty() && m_dirtyBands.size() > 1);
+	if(wake) {
+		m_mutex.lock();
+		__sync_lock_test_and_set(&m_running, (int)m_workers.size());
+		++m_generation;
+		m_startCondition.broadcast();
+		m_mutex.unlock();
+	}
+
+	encodeBands(m_deflater);
+
+	if(wake) {
+		m_mutex.lock();
+		while(__sync_fetch_and_add(&m_running, 0) != 0)
+			m_doneCondition.wait(&m_mutex);
+		m_mutex.unlock();
+	}
+	m_image = NULL;
+
+	if(m_failed)
+		throw Exception("PngEncoder::encode(): Unable to compress the image");
+
+	m_serial = image->getModificationSerial();
+	__sync_add_and_fetch(&m_bandsEncoded, m_dirtyBands.size());
+	__sync_add_and_fetch(&m_bandsReused, m_bands.size() - m_dirtyBands.size());
+
+	data.clear();
+	data.append((const char *)PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+
+	string header;
+	appendUInt32(header, m_width);
+	appendUInt32(header, m_height);
+	header += (char)8;
+	header += (char)colorType;
+	header.append(3, '\0');
+	appendChunk(data, "IHDR", header);
+
+	const map <string, string> &text = image->getTextEntries();
+	for(map <string, string>::const_iterator i = text.begin(); i != text.end(); ++i)
+		appendChunk(data, "tEXt", i->first + '\0' + i->second);
+
+	// the zlib stream is split across IDAT chunks: its header, which
+	// gives a 32K window and roughly the level, each band's data and
+	// then the end of the stream with the checksum of every band
+	int level = (m_settings.level < 2) ? 0 : (m_settings.level < 6) ? 1 : (m_settings.level == 6) ? 2 : 3;
+	unsigned int zlibHeader = (0x78 << 8) | (level << 6);
+	zlibHeader += 31 - (zlibHeader % 31);
+	string start;
+	start += (char)(zlibHeader >> 8);
+	start += (char)(zlibHeader & 0xff);
+	appendChunk(data, "IDAT", start);
+
+	uLong adler = adler32(0L, NULL, 0);
+	for(size_t i = 0; i < m_bands.size(); ++i) {
+		const Band &b = m_bands[i];
+		appendChunk(data, "IDAT", b.data.data(), b.data.length(), b.crc);
+		adler = adler32_combine(adler, b.adler, b.length);
+	}
+
+	string end((const char *)DEFLATE_END, sizeof(DEFLATE_END));
+	appendUInt32(end, adler);
+	appendChunk(data, "IDAT", end);
+	appendChunk(data, "IEND", string());
+}
+
+const PngEncoder::Settings &
+PngEncoder::getSettings() const
+{
+	return m_settings;
+}
+
+unsigned long
+PngEncoder::getBandsEncoded() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_bandsEncoded, 0);
+}
+
+unsigned long
+PngEncoder::getBandsReused() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_bandsReused, 0);
+}
+
+/*
+ * Looks up a filter by name ("none", "sub", "up", "average", "paeth"
+ * or "adaptive"). Returns false if there's no such filter.
+ */
+bool
+PngEncoder::parseFilter(const string &name, Filter *filter)
+{
+	for(int i = FILTER_NONE; i <= FILTER_ADAPTIVE; ++i) {
+		if(name == FILTER_NAMES[i]) {
+			*filter = (Filter)i;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PNGENCODER_H__
+#define __PNGENCODER_H__
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "Image.h"
+#include "Thread.h"
+
+/*
+ * Encodes successive snapshots of one image as PNGs, recompressing
+ * only what changed since the last one. The rows are filtered and
+ * deflated in bands of BAND_ROWS, each band ending on a full flush so
+ * that the compressed bands join into one zlib stream; a band is kept
+ * until a tile in it or in the band above it is drawn in.
+ *
+ * The bands to compress are shared out between threads, like pigz
+ * does with a file. Each band is primed with the end of the band above
+ * it as a dictionary, so splitting the image costs little in size.
+ * The threads, each with a compressor of its own, are started with the
+ * encoder and woken for each image, like TileRenderer's.
+ *
+ * An encoder isn't thread safe; the caller serializes its use.
+ */
+class PngEncoder
+{
+	public:
+		// a band is a row of the image's dirty tiles
+		static const unsigned int BAND_ROWS = Image::TILE_SIZE;
+
+		// how rows are filtered before they're compressed: each with
+		// one filter, or each with whichever suits it best
+		enum Filter {
+			FILTER_NONE,
+			FILTER_SUB,
+			FILTER_UP,
+			FILTER_AVERAGE,
+			FILTER_PAETH,
+			FILTER_ADAPTIVE
+		};
+
+		class Settings
+		{
+			public:
+				// a zlib compression level, 0 to 9
+				int level;
+				Filter filter;
+				unsigned int threads;
+
+				Settings();
+		};
+
+	private:
+		class Band
+		{
+			public:
+				bool valid;
+				std::string data;
+				uLong adler;
+				uLong length;
+				uLong crc;
+		};
+
+		// a compressor and the buffers used to fill it, one for
+		// each thread encoding bands
+		class Deflater
+		{
+			private:
+				Deflater(const Deflater &deflater);
+				Deflater &operator=(const Deflater &deflater);
+
+			public:
+				z_stream stream;
+				std::vector <uint8_t> raw;
+				std::vector <uint8_t> filtered;
+
+				Deflater(const Settings &settings);
+				virtual ~Deflater();
+		};
+
+		class Worker : public Thread
+		{
+			private:
+				PngEncoder *m_encoder;
+
+			protected:
+				void run();
+
+			public:
+				Deflater deflater;
+
+				Worker(PngEncoder *encoder);
+		};
+
+		Settings m_settings;
+
+		// the thread calling encode() uses m_deflater; the
+		// workers wait on m_startCondition for the generation
+		// to change, and the caller waits on m_doneCondition
+		// for every worker it woke to run out of bands
+		Deflater m_deflater;
+		std::vector <Worker *> m_workers;
+		Mutex m_mutex;
+		Condition m_startCondition;
+		Condition m_doneCondition;
+		unsigned int m_generation;
+		bool m_stopping;
+		volatile int m_running;
+
+		unsigned int m_width, m_height;
+		int m_colorComponents;
+		unsigned int m_serial;
+		std::vector <Band> m_bands;
+
+		// the bands being encoded, the next one to take and
+		// whether any failed
+		const Image *m_image;
+		std::vector <unsigned int> m_dirtyBands;
+		volatile unsigned int m_nextBand;
+		volatile int m_failed;
+
+		volatile unsigned long m_bandsEncoded;
+		volatile unsigned long m_bandsReused;
+
+		bool isBandDirty(const Image *image, unsigned int band) const;
+		void filterRows(Deflater &deflater, unsigned int first, unsigned int count);
+		void encodeBand(Deflater &deflater, unsigned int band);
+		void encodeBands(Deflater &deflater);
+
+	public:
+		PngEncoder(const Settings &settings = Settings());
+		virtual ~PngEncoder();
+
+		void encode(const Image *image, std::string &data);
+
+		const Settings &getSettings() const;
+		unsigned long getBandsEncoded() const;
+		unsigned long getBandsReused() const;
+
+		static bool parseFilter(const std::string &name, Filter *filter);
+};
+
+#endif /* __PNGENCODER_H__ */
@@ -127,10 +127,19 @@ PngImage::PngImage(const char *filename_arg)
 	png_read_image(png, rows);
 	png_read_end(png, info);
 
+	// keep any text stored before or after the image data
+	png_textp text;
+	int numText = 0;
+	png_get_text(png, info, &text, &numText);
+	for(int i = 0; i < numText; ++i)
+		m_text[text[i].key] = string(text[i].text, text[i].text_length);
+
 	// finish up
 	delete [] rows;
 	png_destroy_read_struct(&png, &info, (png_infopp)NULL);
 	fclose(fp);
+
+	initTiles();
 }
 
 PngImage *
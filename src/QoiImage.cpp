@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "Exception.h"
+#include "QoiImage.h"
+
+using namespace std;
+
+const uint8_t QoiImage::END_MARKER[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+static uint32_t
+readUInt32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+QoiImage::QoiImage(const char *filename_arg)
+{
+	m_filename = filename_arg;
+
+	// read the whole file
+	FILE *fp = fopen(filename_arg, "rb");
+	if(!fp)
+		throw Exception(string("QoiImage::QoiImage(): Couldn't open ") + filename_arg);
+
+	string file;
+	long size = -1;
+	if(fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+		file.resize(size);
+		if(size > 0 && fread(&file[0], 1, size, fp) != (size_t)size)
+			size = -1;
+	}
+	fclose(fp);
+	if(size < 0)
+		throw Exception(string("QoiImage::QoiImage(): Couldn't read ") + filename_arg);
+
+	// check the header
+	const uint8_t *p = (const uint8_t *)file.data();
+	const uint8_t *end = p + file.length();
+	if(file.length() < HEADER_SIZE + sizeof(END_MARKER) || memcmp(p, "qoif", 4) != 0)
+		throw Exception("QoiImage::QoiImage(): Not a QOI file");
+
+	m_width = readUInt32(p + 4);
+	m_height = readUInt32(p + 8);
+	m_colorComponents = p[12];
+	if(m_width == 0 || m_height == 0 || m_height > MAX_PIXELS / m_width ||
+	   (m_colorComponents != 3 && m_colorComponents != 4))
+		throw Exception("QoiImage::QoiImage(): Invalid header");
+	p += HEADER_SIZE;
+
+	m_data = new uint8_t[(size_t)m_width * m_height * m_colorComponents];
+	try {
+		p = decode(p, end - sizeof(END_MARKER));
+	} catch(Exception &ex) {
+		delete [] m_data;
+		m_data = NULL;
+		throw;
+	}
+
+	// keep any text after the end marker
+	p += sizeof(END_MARKER);
+	while(p < end) {
+		const uint8_t *key = p;
+		while(p < end && *p != 0)
+			++p;
+		if(p == key || end - p < 5)
+			break;
+
+		uint32_t valueLength = readUInt32(p + 1);
+		const uint8_t *value = p + 5;
+		if(valueLength > (size_t)(end - value))
+			break;
+
+		m_text[string((const char *)key, p - key)] = string((const char *)value, valueLength);
+		p = value + valueLength;
+	}
+
+	initTiles();
+}
+
+template <int N> static const uint8_t *
+decodePixels(const uint8_t *p, const uint8_t *end, uint8_t *out, size_t pixels)
+{
+	uint8_t index[64 * 4];
+	memset(index, 0, sizeof(index));
+	uint8_t px[4] = { 0, 0, 0, 255 };
+
+	uint8_t *outEnd = out + (pixels * N);
+	while(out < outEnd) {
+		if(p >= end)
+			throw Exception("QoiImage::decode(): Truncated image data");
+
+		uint8_t op = *p++;
+		if(op == QoiImage::OP_RGB || op == QoiImage::OP_RGBA) {
+			size_t length = (op == QoiImage::OP_RGB) ? 3 : 4;
+			if((size_t)(end - p) < length)
+				throw Exception("QoiImage::decode(): Truncated image data");
+			memcpy(px, p, length);
+			p += length;
+		} else if((op & QoiImage::OP_MASK) == QoiImage::OP_INDEX) {
+			memcpy(px, index + (op * 4), 4);
+		} else if((op & QoiImage::OP_MASK) == QoiImage::OP_DIFF) {
+			px[0] += ((op >> 4) & 0x03) - 2;
+			px[1] += ((op >> 2) & 0x03) - 2;
+			px[2] += (op & 0x03) - 2;
+		} else if((op & QoiImage::OP_MASK) == QoiImage::OP_LUMA) {
+			if(p >= end)
+				throw Exception("QoiImage::decode(): Truncated image data");
+			int dg = (op & 0x3f) - 32;
+			uint8_t b = *p++;
+			px[0] += dg - 8 + ((b >> 4) & 0x0f);
+			px[1] += dg;
+			px[2] += dg - 8 + (b & 0x0f);
+		} else {
+			// the pixel repeats, up to the end of the image
+			size_t run = (op & 0x3f) + 1;
+			if(run > (size_t)(outEnd - out) / N)
+				run = (outEnd - out) / N;
+			for(size_t i = 0; i < run; ++i, out += N)
+				memcpy(out, px, N);
+			continue;
+		}
+
+		memcpy(index + (QoiImage::hash(px) * 4), px, 4);
+		memcpy(out, px, N);
+		out += N;
+	}
+
+	return p;
+}
+
+/*
+ * Decodes the pixels from the data starting at p, which runs up to
+ * end at most, and returns where the pixels end.
+ */
+const uint8_t *
+QoiImage::decode(const uint8_t *p, const uint8_t *end)
+{
+	size_t pixels = (size_t)m_width * m_height;
+	if(m_colorComponents == 4)
+		p = decodePixels<4>(p, end, m_data, pixels);
+	else
+		p = decodePixels<3>(p, end, m_data, pixels);
+
+	if(memcmp(p, END_MARKER, sizeof(END_MARKER)) != 0)
+		throw Exception("QoiImage::decode(): Missing end marker");
+
+	return p;
+}
+
+QoiImage *
+QoiImage::load(const char *filename)
+{
+	return new QoiImage(filename);
+}
+
+/*
+ * Returns the slot a pixel takes in the table of recently seen pixels.
+ */
+unsigned int
+QoiImage::hash(const uint8_t *rgba)
+{
+	return ((rgba[0] * 3) + (rgba[1] * 5) + (rgba[2] * 7) + (rgba[3] * 11)) % 64;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QOIIMAGE_H__
+#define __QOIIMAGE_H__
+
+#include "Image.h"
+
+/*
+ * An image read from a QOI file ("Quite OK Image" format), which is
+ * lossless and several times quicker to write and read than a PNG, if
+ * larger. It's used for the checkpoints the server keeps for itself.
+ * QOI has no place for text, so the image's text follows the end
+ * marker, where other decoders don't look: each entry is the key, a
+ * zero byte, the length of the value as a 32-bit big-endian number
+ * and the value.
+ */
+class QoiImage : public Image
+{
+	public:
+		static const uint8_t OP_INDEX = 0x00;
+		static const uint8_t OP_DIFF = 0x40;
+		static const uint8_t OP_LUMA = 0x80;
+		static const uint8_t OP_RUN = 0xc0;
+		static const uint8_t OP_RGB = 0xfe;
+		static const uint8_t OP_RGBA = 0xff;
+		static const uint8_t OP_MASK = 0xc0;
+
+		static const unsigned int HEADER_SIZE = 14;
+		static const uint8_t END_MARKER[8];
+
+		// the largest image read, as in the reference decoder
+		static const unsigned int MAX_PIXELS = 400000000;
+
+		static unsigned int hash(const uint8_t *rgba);
+
+	protected:
+		QoiImage(const char *filename_arg);
+
+		const uint8_t *decode(const uint8_t *p, const uint8_t *end);
+
+	public:
+		static QoiImage *load(const char *filename);
+};
+
+#endif /* __QOIIMAGE_H__ */
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <sched.h>
+#include "Exception.h"
+#include "RenderThread.h"
+#include "Util.h"
+
+using namespace std;
+
+RenderThread::RenderThread(unsigned int drawThreads)
+{
+	m_stub.next = NULL;
+	m_head = &m_stub;
+	m_tail = &m_stub;
+
+	m_sleeping = 0;
+	m_stopping = 0;
+	m_queueing = 0;
+
+	m_painter = new Painter();
+	m_tileRenderer = (drawThreads > 1) ? new TileRenderer(drawThreads) : NULL;
+
+	m_depth = 0;
+	m_maxDepth = 0;
+	m_updatesQueued = 0;
+	m_updatesRendered = 0;
+	m_batches = 0;
+	m_queueTime = 0;
+	m_renderTime = 0;
+	m_publishTime = 0;
+}
+
+RenderThread::~RenderThread()
+{
+	stop();
+	delete m_tileRenderer;
+	delete m_painter;
+}
+
+/*
+ * Adds a node at the head of the queue. Any number of threads can
+ * push at once; each swaps its node in as the new head and then links
+ * the old head to it.
+ */
+void
+RenderThread::push(Node *node)
+{
+	node->next = NULL;
+
+	// compare-and-swap is a full barrier, so the node's contents are
+	// visible before it can be reached (test-and-set only acquires)
+	Node *prev = &m_stub;
+	Node *head;
+	while((head = __sync_val_compare_and_swap(&m_head, prev, node)) != prev)
+		prev = head;
+
+	(void)__sync_val_compare_and_swap(&prev->next, (Node *)NULL, node);
+}
+
+/*
+ * Reads a node's next pointer, which a pushing thread may be writing.
+ */
+RenderThread::Node *
+RenderThread::loadNext(Node *node)
+{
+	return __sync_val_compare_and_swap(&node->next, (Node *)NULL, (Node *)NULL);
+}
+
+/*
+ * Takes the node at the tail of the queue, or returns NULL if the queue
+ * is empty. A push that has swapped in a new head but hasn't linked it
+ * yet also looks empty for a moment. Only the render thread pops.
+ */
+RenderThread::Node *
+RenderThread::pop()
+{
+	Node *tail = m_tail;
+	Node *next = loadNext(tail);
+
+	// skip over the stub
+	if(tail == &m_stub) {
+		if(next == NULL)
+			return NULL;
+		m_tail = next;
+		tail = next;
+		next = loadNext(next);
+	}
+
+	if(next != NULL) {
+		__sync_synchronize();
+		m_tail = next;
+		return tail;
+	}
+
+	// the tail is the last node; put the stub back
+	// behind it so that it can be taken off
+	if(tail != __sync_val_compare_and_swap(&m_head, NULL, NULL))
+		return NULL;
+	push(&m_stub);
+
+	next = loadNext(tail);
+	if(next != NULL) {
+		__sync_synchronize();
+		m_tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+/*
+ * Queues an update to be drawn in a room. The room must be pinned by
+ * the caller; it's pinned again until the update has been published.
+ * Returns false if the queue is full or the thread is stopping.
+ */
+bool
+RenderThread::queue(Room *room, const PaintUpdate &update)
+{
+	// counted before m_stopping is checked, so a call that
+	// gets past the check is always waited for by stop()
+	__sync_add_and_fetch(&m_queueing, 1);
+	if(__sync_fetch_and_add(&m_stopping, 0)) {
+		__sync_sub_and_fetch(&m_queueing, 1);
+		return false;
+	}
+
+	int depth = __sync_add_and_fetch(&m_depth, 1);
+	if(depth > MAX_DEPTH) {
+		__sync_sub_and_fetch(&m_depth, 1);
+		__sync_sub_and_fetch(&m_queueing, 1);
+		return false;
+	}
+
+	int maxDepth;
+	while(depth > (maxDepth = __sync_fetch_and_add(&m_maxDepth, 0)) && !__sync_bool_compare_and_swap(&m_maxDepth, maxDepth, depth))
+		;
+
+	Node *node = new Node;
+	node->room = room;
+	node->update = update;
+	node->queueTime = getMicroseconds();
+	room->pin();
+
+	push(node);
+	__sync_add_and_fetch(&m_updatesQueued, 1);
+
+	// wake the render thread if it's waiting for updates
+	if(__sync_fetch_and_add(&m_sleeping, 0)) {
+		m_mutex.lock();
+		m_condition.signal();
+		m_mutex.unlock();
+	}
+
+	__sync_sub_and_fetch(&m_queueing, 1);
+	return true;
+}
+
+/*
+ * Draws the updates of a batch one at a time.
+ */
+void
+RenderThread::renderSerial(vector <Node *> &batch)
+{
+	for(size_t i = 0; i < batch.size(); ++i) {
+		try {
+			batch[i]->room->renderUpdate(batch[i]->update, m_painter);
+		} catch(Exception &ex) {
+			// an update that can't be drawn is dropped
+		}
+	}
+}
+
+/*
+ * Draws all of the updates of a batch to each room at once with the
+ * tile renderer.
+ */
+void
+RenderThread::renderTiled(vector <Node *> &batch)
+{
+	vector <bool> done(batch.size(), false);
+	vector <PaintUpdate *> updates;
+
+	for(size_t i = 0; i < batch.size(); ++i) {
+		if(done[i])
+			continue;
+
+		// gather the room's updates, keeping their order
+		Room *room = batch[i]->room;
+		updates.clear();
+		for(size_t j = i; j < batch.size(); ++j) {
+			if(batch[j]->room == room) {
+				updates.push_back(&batch[j]->update);
+				done[j] = true;
+			}
+		}
+
+		try {
+			room->renderUpdates(updates, m_tileRenderer);
+		} catch(Exception &ex) {
+			// updates that can't be drawn are dropped
+		}
+	}
+}
+
+/*
+ * Draws a batch of updates, then publishes the new updates of every
+ * room in the batch. Updates to a room are drawn in the order they
+ * were queued.
+ */
+void
+RenderThread::renderBatch(vector <Node *> &batch)
+{
+	long start = getMicroseconds();
+	unsigned long queueTime = 0;
+	vector <Room *> rooms;
+
+	for(size_t i = 0; i < batch.size(); ++i) {
+		Node *node = batch[i];
+		queueTime += start - node->queueTime;
+		if(find(rooms.begin(), rooms.end(), node->room) == rooms.end())
+			rooms.push_back(node->room);
+	}
+
+	if(m_tileRenderer != NULL)
+		renderTiled(batch);
+	else
+		renderSerial(batch);
+	long rendered = getMicroseconds();
+
+	long time = getMilliseconds();
+	for(size_t i = 0; i < rooms.size(); ++i)
+		rooms[i]->publish(time);
+	long published = getMicroseconds();
+
+	for(size_t i = 0; i < batch.size(); ++i) {
+		batch[i]->room->unpin();
+		delete batch[i];
+	}
+
+	__sync_add_and_fetch(&m_updatesRendered, batch.size());
+	__sync_add_and_fetch(&m_batches, 1);
+	__sync_add_and_fetch(&m_queueTime, queueTime);
+	__sync_add_and_fetch(&m_renderTime, rendered - start);
+	__sync_add_and_fetch(&m_publishTime, published - rendered);
+	batch.clear();
+}
+
+void
+RenderThread::run()
+{
+	vector <Node *> batch;
+
+	while(true) {
+		Node *node;
+		while(batch.size() < MAX_BATCH && (node = pop()) != NULL) {
+			__sync_sub_and_fetch(&m_depth, 1);
+			batch.push_back(node);
+		}
+
+		if(!batch.empty()) {
+			renderBatch(batch);
+			continue;
+		}
+
+		// nothing is queued; flag that this thread is going to sleep,
+		// then look once more so that no push can be missed in between
+		m_mutex.lock();
+		__sync_fetch_and_or(&m_sleeping, 1);
+		node = pop();
+		if(node == NULL && !__sync_fetch_and_add(&m_stopping, 0))
+			m_condition.wait(&m_mutex);
+		__sync_fetch_and_and(&m_sleeping, 0);
+		m_mutex.unlock();
+
+		if(node != NULL) {
+			__sync_sub_and_fetch(&m_depth, 1);
+			batch.push_back(node);
+		} else if(__sync_fetch_and_add(&m_stopping, 0)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Draws everything still queued and stops the render thread.
+ */
+void
+RenderThread::stop()
+{
+	m_mutex.lock();
+	__sync_fetch_and_or(&m_stopping, 1);
+	m_condition.signal();
+	m_mutex.unlock();
+
+	join();
+
+	// wait out any request that was already queueing when
+	// m_stopping was set, then draw what it queued here
+	while(__sync_fetch_and_add(&m_queueing, 0) != 0)
+		sched_yield();
+
+	vector <Node *> batch;
+	Node *node;
+	while((node = pop()) != NULL) {
+		__sync_sub_and_fetch(&m_depth, 1);
+		batch.push_back(node);
+	}
+	if(!batch.empty())
+		renderBatch(batch);
+}
+
+int
+RenderThread::getDepth() const
+{
+	return __sync_fetch_and_add((int *)&m_depth, 0);
+}
+
+int
+RenderThread::getMaxDepth() const
+{
+	return __sync_fetch_and_add((int *)&m_maxDepth, 0);
+}
+
+unsigned long
+RenderThread::getUpdatesQueued() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_updatesQueued, 0);
+}
+
+unsigned long
+RenderThread::getUpdatesRendered() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_updatesRendered, 0);
+}
+
+unsigned long
+RenderThread::getBatches() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_batches, 0);
+}
+
+unsigned long
+RenderThread::getQueueTime() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_queueTime, 0);
+}
+
+unsigned long
+RenderThread::getRenderTime() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_renderTime, 0);
+}
+
+unsigned long
+RenderThread::getPublishTime() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_publishTime, 0);
+}
+
+unsigned int
+RenderThread::getDrawThreadCount() const
+{
+	return (m_tileRenderer != NULL) ? m_tileRenderer->getThreadCount() : 1;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __RENDERTHREAD_H__
+#define __RENDERTHREAD_H__
+
+#include <vector>
+#include "Painter.h"
+#include "Room.h"
+#include "Thread.h"
+#include "TileRenderer.h"
+#include "UpdateLog.h"
+
+/*
+ * Draws posted updates on a thread of its own, so request handlers
+ * only parse an update and queue it. Updates are queued on a lock-free
+ * multiple-producer, single-consumer queue. The render thread drains
+ * it in batches, logs and draws each update in its room, and then
+ * marks every room's connections as having new updates once per batch.
+ * Given more than one thread to draw with, each room's updates in a
+ * batch are drawn together, a tile at a time in parallel.
+ */
+class RenderThread : public Thread
+{
+	private:
+		class Node
+		{
+			public:
+				Node *volatile next;
+				Room *room;
+				PaintUpdate update;
+				long queueTime;
+		};
+
+		// producers swap themselves in at the head, and the render
+		// thread takes from the tail; m_stub keeps the list non-empty
+		Node *volatile m_head;
+		Node *m_tail;
+		Node m_stub;
+
+		// the render thread sleeps on the condition when the queue
+		// is empty, after setting m_sleeping for producers to see
+		Mutex m_mutex;
+		Condition m_condition;
+		volatile int m_sleeping;
+		volatile int m_stopping;
+
+		// how many queue calls are in progress, so that stopping can
+		// wait for any that got past the check of m_stopping
+		volatile int m_queueing;
+
+		Painter *m_painter;
+		TileRenderer *m_tileRenderer;
+
+		// stage counters, in microseconds where they're times
+		volatile int m_depth;
+		volatile int m_maxDepth;
+		volatile unsigned long m_updatesQueued;
+		volatile unsigned long m_updatesRendered;
+		volatile unsigned long m_batches;
+		volatile unsigned long m_queueTime;
+		volatile unsigned long m_renderTime;
+		volatile unsigned long m_publishTime;
+
+		void push(Node *node);
+		static Node *loadNext(Node *node);
+		Node *pop();
+		void renderSerial(std::vector <Node *> &batch);
+		void renderTiled(std::vector <Node *> &batch);
+		void renderBatch(std::vector <Node *> &batch);
+
+	protected:
+		void run();
+
+	public:
+		// updates beyond this many waiting are turned away
+		static const int MAX_DEPTH = 65536;
+
+		// the most updates drawn before publishing
+		static const unsigned int MAX_BATCH = 256;
+
+		RenderThread(unsigned int drawThreads);
+		virtual ~RenderThread();
+
+		bool queue(Room *room, const PaintUpdate &update);
+		void stop();
+
+		int getDepth() const;
+		int getMaxDepth() const;
+		unsigned long getUpdatesQueued() const;
+		unsigned long getUpdatesRendered() const;
+		unsigned long getBatches() const;
+		unsigned long getQueueTime() const;
+		unsigned long getRenderTime() const;
+		unsigned long getPublishTime() const;
+		unsigned int getDrawThreadCount() const;
+};
+
+#endif /* __RENDERTHREAD_H__ */
@@ -0,0 +1,722 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <xviweb/String.h>
+#include "Encoding.h"
+#include "Exception.h"
+#include "PaintContext.h"
+#include "PaintResponder.h"
+#include "Room.h"
+#include "TiledImage.h"
+#include "Util.h"
+
+// updates are kept for this many milliseconds, up to this many at a time
+const long UPDATE_MAX_AGE = 60000;
+const unsigned int UPDATE_LOG_CAPACITY = 8192;
+
+// a changed canvas is saved at most this often, in milliseconds
+const long SAVE_INTERVAL = 15000;
+
+// the canvas is checkpointed as QOI, which is several times quicker
+// to write and read than PNG; PNGs are only made when asked for
+const char *CHECKPOINT_EXTENSION = ".qoi";
+
+// saved canvases hold the first journal segment they don't include
+const char *JOURNAL_TEXT_KEY = "xvipaint-journal";
+
+using namespace std;
+
+/*
+ * Loads a saved canvas, or returns NULL if there's no such file. A file
+ * that's there but can't be read is an error rather than a reason to
+ * start over, which would lose the canvas along with every journal
+ * segment it doesn't hold.
+ */
+static Image *
+loadCanvas(const string &filename)
+{
+	if(access(filename.c_str(), F_OK) != 0)
+		return NULL;
+
+	try {
+		return Image::load(filename);
+	} catch(Exception &ex) {
+		cout << "Room::Room(): " << filename << " can't be read; the room won't load until it's repaired or moved aside" << endl;
+		throw;
+	}
+}
+
+Room::Room(const string &name, const string &filename, const string &tagPrefix,
+           const PngEncoder::Settings &pngSettings) : m_canvasEncoder(pngSettings)
+{
+	m_name = name;
+	m_filename = filename;
+
+	// the canvas is checkpointed in a format that's quick to write
+	// and read; a canvas file in any other format, such as one from
+	// before checkpoints were kept, is only read if there's no
+	// checkpoint yet
+	m_checkpointFilename = m_filename.substr(0, m_filename.find_last_of('.')) + CHECKPOINT_EXTENSION;
+	Image *image = loadCanvas(m_checkpointFilename);
+	if(image == NULL && m_checkpointFilename != m_filename)
+		image = loadCanvas(m_filename);
+
+	m_updates = new UpdateLog(UPDATE_LOG_CAPACITY);
+	m_userCount = 0;
+	m_pins = 0;
+
+	unsigned int firstSegment = 0;
+	if(image != NULL) {
+		// keep the canvas in tiles so snapshots of it are cheap
+		m_image = new TiledImage(image);
+		firstSegment = (unsigned int)atoi(image->getText(JOURNAL_TEXT_KEY).c_str());
+		delete image;
+	} else {
+		// create a new image if one doesn't already exist; it's
+		// only written out once something is drawn on it, so
+		// looking up a room doesn't leave files behind
+		m_image = new TiledImage(800, 450, 3);
+	}
+	m_saver = new CanvasSaver(m_image->getModificationSerial());
+
+	// draw whatever was journaled since the canvas was saved; the
+	// canvas then counts as changed, so it's saved again soon
+	m_journal = new Journal(m_filename);
+	m_journal->open(firstSegment, m_image);
+	m_journal->start();
+
+	m_lastSaveTime = getMilliseconds();
+	m_lastActiveTime = m_lastSaveTime;
+
+	m_tileColumns = m_image->getTileColumns();
+	m_tileRows = m_image->getTileRows();
+	m_tileLocks = new Mutex[m_tileColumns * m_tileRows];
+	m_tileVersions.assign(m_tileColumns * m_tileRows, 0);
+
+	m_saver->start();
+
+	// serials start over whenever a room is loaded, so entity tags
+	// for the canvas are prefixed with something unique to this load
+	m_canvasPngSerial = m_image->getModificationSerial() - 1;
+	m_canvasPngUpdateId = 0;
+	m_canvasPngTagPrefix = tagPrefix;
+
+	m_canvasFrameSerial = m_canvasPngSerial;
+	m_tileFrames.resize(m_tileColumns * m_tileRows);
+	m_tileFrameVersions.assign(m_tileColumns * m_tileRows, -1);
+	m_tileCatchUps = 0;
+	m_canvasCatchUps = 0;
+	m_catchUpTiles = 0;
+}
+
+Room::~Room()
+{
+	// let any save in flight finish, then write
+	// out whatever has been drawn since
+	m_saver->stop();
+	if(m_image->isDirty(m_saver->getSavedSerial())) {
+		Image *image = checkpoint();
+		m_saver->saveNow(image, m_checkpointFilename);
+		delete image;
+	}
+
+	// the journal is only needed for what didn't make it into the canvas
+	m_journal->stop();
+	string segment = m_saver->getSavedText(JOURNAL_TEXT_KEY);
+	if(!segment.empty())
+		m_journal->discardBefore((unsigned int)atoi(segment.c_str()));
+	delete m_journal;
+	delete m_saver;
+
+	delete [] m_tileLocks;
+	delete m_image;
+	delete m_updates;
+}
+
+/*
+ * Locks the tiles overlapping the given pixel rectangle, which is
+ * clipped to the canvas. Tiles are locked in row-major order, so two
+ * threads locking overlapping regions can't deadlock.
+ */
+void
+Room::lockTiles(int left, int top, int right, int bottom)
+{
+	int lastColumn = min(right / (int)Image::TILE_SIZE, (int)m_tileColumns - 1);
+	int lastRow = min(bottom / (int)Image::TILE_SIZE, (int)m_tileRows - 1);
+	for(int row = max(top, 0) / (int)Image::TILE_SIZE; row <= lastRow; ++row) {
+		for(int column = max(left, 0) / (int)Image::TILE_SIZE; column <= lastColumn; ++column)
+			m_tileLocks[(row * m_tileColumns) + column].lock();
+	}
+}
+
+void
+Room::unlockTiles(int left, int top, int right, int bottom)
+{
+	int lastColumn = min(right / (int)Image::TILE_SIZE, (int)m_tileColumns - 1);
+	int lastRow = min(bottom / (int)Image::TILE_SIZE, (int)m_tileRows - 1);
+	for(int row = max(top, 0) / (int)Image::TILE_SIZE; row <= lastRow; ++row) {
+		for(int column = max(left, 0) / (int)Image::TILE_SIZE; column <= lastColumn; ++column)
+			m_tileLocks[(row * m_tileColumns) + column].unlock();
+	}
+}
+
+/*
+ * Records an update as the last one drawn in the tiles overlapping the
+ * given pixel rectangle. The tiles must be locked.
+ */
+void
+Room::markTiles(int left, int top, int right, int bottom, int updateId)
+{
+	int lastColumn = min(right / (int)Image::TILE_SIZE, (int)m_tileColumns - 1);
+	int lastRow = min(bottom / (int)Image::TILE_SIZE, (int)m_tileRows - 1);
+	for(int row = max(top, 0) / (int)Image::TILE_SIZE; row <= lastRow; ++row) {
+		for(int column = max(left, 0) / (int)Image::TILE_SIZE; column <= lastColumn; ++column)
+			m_tileVersions[(row * m_tileColumns) + column] = updateId;
+	}
+}
+
+/*
+ * Records an update as the last one drawn in each tile a segment of
+ * its stroke can reach, allowing margin pixels for the brush. Going by
+ * segments rather than the stroke's bounds keeps a long diagonal or
+ * bent stroke from claiming tiles it never touched. The tiles must be
+ * locked.
+ */
+void
+Room::markStroke(const PaintUpdate &update, int margin)
+{
+	for(unsigned int i = 0; i < update.stroke.getPolylineCount(); ++i) {
+		unsigned int count;
+		const int16_t *points = update.stroke.getPolyline(i, &count);
+
+		// a polyline of one point is a dot
+		for(unsigned int j = (count == 1) ? 0 : 1; j < count; ++j) {
+			const int16_t *p = points + (((count == 1) ? 0 : j - 1) * 2);
+			const int16_t *q = points + (j * 2);
+			markTiles(min(p[0], q[0]) - margin, min(p[1], q[1]) - margin,
+			          max(p[0], q[0]) + margin, max(p[1], q[1]) + margin, update.updateId);
+		}
+	}
+}
+
+/*
+ * Takes a snapshot of the canvas with every tile locked. If updateId
+ * isn't NULL, it's set to the id of the last update the snapshot holds.
+ */
+Image *
+Room::snapshot(int *updateId)
+{
+	int right = (int)m_image->getWidth() - 1;
+	int bottom = (int)m_image->getHeight() - 1;
+
+	lockTiles(0, 0, right, bottom);
+	Image *image = m_image->snapshot();
+	if(updateId != NULL)
+		*updateId = m_updates->getLastId();
+	unlockTiles(0, 0, right, bottom);
+
+	return image;
+}
+
+/*
+ * Takes a snapshot of the canvas to be saved, starting a new journal
+ * segment for the updates drawn after it. The snapshot is labeled with
+ * the new segment, so it's where replay starts from once it's saved.
+ */
+Image *
+Room::checkpoint()
+{
+	int right = (int)m_image->getWidth() - 1;
+	int bottom = (int)m_image->getHeight() - 1;
+
+	lockTiles(0, 0, right, bottom);
+	Image *image = m_image->snapshot();
+	unsigned int segment = m_journal->startSegment();
+	unlockTiles(0, 0, right, bottom);
+
+	image->setText(JOURNAL_TEXT_KEY, String::fromInt((int)segment));
+	return image;
+}
+
+/*
+ * Saves the canvas if it's due to be saved and drops old updates.
+ */
+void
+Room::updateImage(long time)
+{
+	// if the image was last updated more than 15 seconds ago, update it
+	bool save = false;
+	m_mutex.lock();
+	if((time - m_lastSaveTime) > SAVE_INTERVAL) {
+		m_lastSaveTime = time;
+		save = true;
+	}
+	m_mutex.unlock();
+
+	// skip the save entirely if nothing has been drawn since the
+	// last one; otherwise hand a snapshot to the background saver
+	if(save && m_image->isDirty(m_saver->getSavedSerial()))
+		m_saver->save(checkpoint(), m_checkpointFilename);
+
+	// drop the journal segments that the last save holds
+	string segment = m_saver->getSavedText(JOURNAL_TEXT_KEY);
+	if(!segment.empty())
+		m_journal->discardBefore((unsigned int)atoi(segment.c_str()));
+
+	// drop old updates; this only ever looks at the oldest ones
+	m_updates->expire(time, UPDATE_MAX_AGE);
+}
+
+/*
+ * Logs an update and draws it on the canvas. The update isn't sent to
+ * the room's connections until the room is next published.
+ */
+void
+Room::renderUpdate(PaintUpdate &update, Painter *painter)
+{
+	update.updateTime = getMilliseconds();
+
+	// lock the tiles the stroke can reach, allowing for the brush
+	int left, top, right, bottom;
+	if(!update.stroke.getBounds(&left, &top, &right, &bottom))
+		return;
+	int margin = ((update.brushSize > 0 && update.brushSize < 32) ? update.brushSize : 32) + 1;
+	left -= margin;
+	top -= margin;
+	right += margin;
+	bottom += margin;
+
+	lockTiles(left, top, right, bottom);
+	try {
+		m_updates->append(update);
+		m_journal->append(update);
+		markStroke(update, margin);
+		painter->processUpdate(m_image, update.brushSize, update.brushColor, update.stroke);
+	} catch(Exception &ex) {
+		unlockTiles(left, top, right, bottom);
+		throw;
+	}
+	unlockTiles(left, top, right, bottom);
+
+	m_mutex.lock();
+	m_lastActiveTime = update.updateTime;
+	m_mutex.unlock();
+}
+
+/*
+ * Logs a run of updates and draws them on the canvas with the tile
+ * renderer. The canvas comes out just as it would if each update were
+ * rendered in turn with renderUpdate.
+ */
+void
+Room::renderUpdates(const vector <PaintUpdate *> &updates, TileRenderer *renderer)
+{
+	long time = getMilliseconds();
+
+	// lock the tiles any of the strokes can reach, allowing for the brush
+	vector <PaintUpdate *> drawn;
+	vector <int> margins;
+	int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+	for(size_t i = 0; i < updates.size(); ++i) {
+		PaintUpdate *update = updates[i];
+		update->updateTime = time;
+
+		int strokeLeft, strokeTop, strokeRight, strokeBottom;
+		if(!update->stroke.getBounds(&strokeLeft, &strokeTop, &strokeRight, &strokeBottom))
+			continue;
+		int margin = ((update->brushSize > 0 && update->brushSize < 32) ? update->brushSize : 32) + 1;
+		left = min(left, strokeLeft - margin);
+		top = min(top, strokeTop - margin);
+		right = max(right, strokeRight + margin);
+		bottom = max(bottom, strokeBottom + margin);
+		drawn.push_back(update);
+		margins.push_back(margin);
+	}
+	if(drawn.empty())
+		return;
+
+	lockTiles(left, top, right, bottom);
+	try {
+		for(size_t i = 0; i < drawn.size(); ++i) {
+			m_updates->append(*drawn[i]);
+			m_journal->append(*drawn[i]);
+			markStroke(*drawn[i], margins[i]);
+		}
+		renderer->render(m_image, drawn);
+	} catch(Exception &ex) {
+		unlockTiles(left, top, right, bottom);
+		throw;
+	}
+	unlockTiles(left, top, right, bottom);
+
+	m_mutex.lock();
+	m_lastActiveTime = time;
+	m_mutex.unlock();
+}
+
+/*
+ * Lets the room's connections know about the updates rendered since
+ * the last time, and saves the canvas if it's due to be saved.
+ */
+void
+Room::publish(long time)
+{
+	updateImage(time);
+	notifySubscribers();
+}
+
+/*
+ * Gathers the frames of the updates made by other users since
+ * userLastUpdateId, in binary if the client asked for it, and returns
+ * the id to continue from. The frames are shared with the update log,
+ * so nothing is formatted or copied per client. A client that has
+ * missed updates the log no longer holds is caught up first.
+ */
+int
+Room::getUpdates(int userId, int userLastUpdateId, bool binary,
+                 vector <SharedBuffer> &frames)
+{
+	int lastId;
+	if(m_updates->getFrames(userId, userLastUpdateId, binary, frames, &lastId))
+		return lastId;
+
+	vector <SharedBuffer> catchUpFrames;
+	int updateId = catchUp(userLastUpdateId, catchUpFrames);
+	if(!m_updates->getFrames(userId, updateId, binary, frames, &lastId))
+		lastId = updateId;
+
+	frames.insert(frames.begin(), catchUpFrames.begin(), catchUpFrames.end());
+	return lastId;
+}
+
+/*
+ * Brings a client whose canvas holds the updates up to afterId up to
+ * date without the updates themselves, and returns the id of the last
+ * update the client then has. The frames patch in each tile drawn in
+ * since afterId ("ct:x,y:<png>"), or replace the whole canvas if more
+ * than half of the tiles have been drawn in or the client's canvas is
+ * from before the room was loaded ("cs:<png>"); a last frame gives the
+ * id to continue from ("ci:id").
+ * Encoded frames are kept, so a crowd of clients reconnecting at once
+ * only costs one encoding of each tile. Tiles are encoded under a lock
+ * of their own, so nothing but other catch-ups waits for them.
+ */
+int
+Room::catchUp(int afterId, vector <SharedBuffer> &frames)
+{
+	int right = (int)m_image->getWidth() - 1;
+	int bottom = (int)m_image->getHeight() - 1;
+
+	lockTiles(0, 0, right, bottom);
+	Image *image = m_image->snapshot();
+	int updateId = m_updates->getLastId();
+	vector <int> versions = m_tileVersions;
+	unlockTiles(0, 0, right, bottom);
+
+	vector <unsigned int> tiles;
+	for(unsigned int i = 0; i < versions.size(); ++i) {
+		if(versions[i] > afterId)
+			tiles.push_back(i);
+	}
+
+	try {
+		if(afterId > updateId || tiles.size() * 2 > versions.size()) {
+			MutexLocker locker(&m_canvasMutex);
+
+			// the snapshot may be older than one encoded since
+			// it was taken, in which case that one is sent
+			if((int)(image->getModificationSerial() - m_canvasPngSerial) > 0)
+				encodeCanvasPng(image, updateId);
+			if(m_canvasFrameSerial != m_canvasPngSerial) {
+				string frame = "cs:";
+				encodeBase64(m_canvasPng.getString(), frame);
+				m_canvasFrame = SharedBuffer(frame + "\n");
+				m_canvasFrameSerial = m_canvasPngSerial;
+			}
+
+			frames.push_back(m_canvasFrame);
+			updateId = m_canvasPngUpdateId;
+			__sync_add_and_fetch(&m_canvasCatchUps, 1);
+		} else {
+			MutexLocker locker(&m_tileFrameMutex);
+
+			for(size_t i = 0; i < tiles.size(); ++i) {
+				unsigned int tile = tiles[i];
+				if(m_tileFrameVersions[tile] == versions[tile]) {
+					frames.push_back(m_tileFrames[tile]);
+					continue;
+				}
+
+				unsigned int x = (tile % m_tileColumns) * Image::TILE_SIZE;
+				unsigned int y = (tile / m_tileColumns) * Image::TILE_SIZE;
+				Image *tileImage = image->crop(x, y, Image::TILE_SIZE, Image::TILE_SIZE);
+				string png;
+				try {
+					tileImage->encodePng(png);
+				} catch(Exception &ex) {
+					delete tileImage;
+					throw;
+				}
+				delete tileImage;
+
+				string frame = "ct:" + String::fromInt((int)x) + "," + String::fromInt((int)y) + ":";
+				encodeBase64(png, frame);
+				frames.push_back(SharedBuffer(frame + "\n"));
+
+				// a snapshot taken before the tile's last encoding
+				// doesn't replace it
+				if(m_tileFrameVersions[tile] < versions[tile]) {
+					m_tileFrames[tile] = frames.back();
+					m_tileFrameVersions[tile] = versions[tile];
+				}
+			}
+			__sync_add_and_fetch(&m_tileCatchUps, 1);
+			__sync_add_and_fetch(&m_catchUpTiles, tiles.size());
+		}
+	} catch(Exception &ex) {
+		delete image;
+		throw;
+	}
+	delete image;
+
+	frames.push_back(SharedBuffer("ci:" + String::fromInt(updateId) + "\n"));
+	return updateId;
+}
+
+/*
+ * Encodes a snapshot of the canvas holding the updates up to updateId
+ * as the canvas PNG. The canvas lock must be held.
+ */
+void
+Room::encodeCanvasPng(Image *snapshot, int updateId)
+{
+	string png;
+	m_canvasEncoder.encode(snapshot, png);
+
+	m_canvasPng = SharedBuffer(png);
+	m_canvasPngSerial = snapshot->getModificationSerial();
+	m_canvasPngUpdateId = updateId;
+}
+
+/*
+ * Returns the canvas encoded as a PNG, setting tag to its entity tag
+ * and updateId to the last update it holds. The canvas is only
+ * re-encoded if it has changed since it last was, and it's encoded
+ * from a snapshot, so drawing carries on while it's being encoded.
+ */
+SharedBuffer
+Room::getCanvasPng(string &tag, int *updateId)
+{
+	MutexLocker locker(&m_canvasMutex);
+
+	if(m_image->isDirty(m_canvasPngSerial)) {
+		int snapshotUpdateId;
+		Image *image = snapshot(&snapshotUpdateId);
+
+		try {
+			encodeCanvasPng(image, snapshotUpdateId);
+		} catch(Exception &ex) {
+			delete image;
+			throw;
+		}
+		delete image;
+	}
+
+	m_mutex.lock();
+	m_lastActiveTime = getMilliseconds();
+	m_mutex.unlock();
+
+	tag = "\"" + m_canvasPngTagPrefix + "-" + String::fromInt((int)m_canvasPngSerial) + "\"";
+	*updateId = m_canvasPngUpdateId;
+	return m_canvasPng;
+}
+
+/*
+ * Gathers the frames that bring a copy of the canvas saved by a client
+ * up to date, given the epoch and update id it was saved at, and
+ * returns the id of the last update the copy then holds. Update ids
+ * only count from when the room was loaded, so a copy from another
+ * epoch is replaced whole.
+ */
+int
+Room::getTiles(const string &epoch, int updateId, vector <SharedBuffer> &frames)
+{
+	if(epoch != m_canvasPngTagPrefix)
+		updateId = -1;
+
+	return catchUp(updateId, frames);
+}
+
+/*
+ * Marks every connection as having new updates or a new user count.
+ * This is called from the render thread, so it only sets a flag on
+ * each connection; the server thread does the encoding and sending
+ * when the connection next wakes up.
+ */
+void
+Room::notifySubscribers()
+{
+	MutexLocker locker(&m_subscriberMutex);
+
+	for(set <PaintContext *>::iterator i = m_subscribers.begin(); i != m_subscribers.end(); ++i)
+		(*i)->markPending();
+}
+
+void
+Room::subscribe(PaintContext *context)
+{
+	m_subscriberMutex.lock();
+	m_subscribers.insert(context);
+	__sync_add_and_fetch(&m_userCount, 1);
+	m_subscriberMutex.unlock();
+
+	notifySubscribers();
+}
+
+void
+Room::unsubscribe(PaintContext *context)
+{
+	m_subscriberMutex.lock();
+	m_subscribers.erase(context);
+	__sync_sub_and_fetch(&m_userCount, 1);
+	m_subscriberMutex.unlock();
+
+	m_mutex.lock();
+	m_lastActiveTime = getMilliseconds();
+	m_mutex.unlock();
+
+	notifySubscribers();
+}
+
+/*
+ * Marks every connection for a keepalive. The connections that have
+ * sent something since the last time skip it when they wake up.
+ */
+void
+Room::markKeepalives()
+{
+	MutexLocker locker(&m_subscriberMutex);
+
+	for(set <PaintContext *>::iterator i = m_subscribers.begin(); i != m_subscribers.end(); ++i)
+		(*i)->markKeepalive();
+}
+
+/*
+ * Pins are only taken while the responder's shard lock for the room is
+ * held, so a room seen with no pins under that lock can be evicted.
+ */
+void
+Room::pin()
+{
+	__sync_add_and_fetch(&m_pins, 1);
+}
+
+void
+Room::unpin()
+{
+	__sync_sub_and_fetch(&m_pins, 1);
+}
+
+int
+Room::getPinCount() const
+{
+	return __sync_fetch_and_add((int *)&m_pins, 0);
+}
+
+/*
+ * Returns a string that differs each time the room is loaded, which
+ * tells which run of the room an update id belongs to.
+ */
+const string &
+Room::getEpoch() const
+{
+	return m_canvasPngTagPrefix;
+}
+
+const string &
+Room::getName() const
+{
+	return m_name;
+}
+
+int
+Room::getUpdateId() const
+{
+	return m_updates->getLastId();
+}
+
+int
+Room::getUserCount() const
+{
+	return __sync_fetch_and_add((int *)&m_userCount, 0);
+}
+
+long
+Room::getLastActiveTime()
+{
+	MutexLocker locker(&m_mutex);
+	return m_lastActiveTime;
+}
+
+unsigned long
+Room::getTileCatchUps() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_tileCatchUps, 0);
+}
+
+unsigned long
+Room::getCanvasCatchUps() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_canvasCatchUps, 0);
+}
+
+unsigned long
+Room::getCatchUpTiles() const
+{
+	return __sync_fetch_and_add((unsigned long *)&m_catchUpTiles, 0);
+}
+
+const PngEncoder *
+Room::getCanvasEncoder() const
+{
+	return &m_canvasEncoder;
+}
+
+CanvasSaver *
+Room::getSaver() const
+{
+	return m_saver;
+}
+
+Journal *
+Room::getJournal() const
+{
+	return m_journal;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROOM_H__
+#define __ROOM_H__
+
+#include <set>
+#include <string>
+#include <vector>
+#include "CanvasSaver.h"
+#include "Image.h"
+#include "Journal.h"
+#include "Painter.h"
+#include "PngEncoder.h"
+#include "SharedBuffer.h"
+#include "Thread.h"
+#include "TileRenderer.h"
+#include "UpdateLog.h"
+
+class PaintContext;
+
+/*
+ * A single board: its canvas, the log of recent updates to it and the
+ * connections getting updates from it. Rooms are loaded from a
+ * checkpoint of their canvas when first used and checkpointed again
+ * when they're evicted, so only the boards in use are kept in memory.
+ * Every update is also journaled, and the journal is replayed over the
+ * checkpoint when the room is loaded, so a crash loses almost nothing
+ * even though the canvas is only checkpointed every so often.
+ *
+ * A room can be used from many threads at once. Strokes lock only the
+ * canvas tiles they can touch, so strokes in different parts of the
+ * canvas are drawn in parallel; snapshots lock every tile. Updates are
+ * logged while their tiles are locked, so a snapshot always holds
+ * exactly the updates up to the last logged one, and a checkpoint
+ * exactly the journal segments before its own. The locks are always
+ * taken in the order subscribers, canvas, tiles, then the update log,
+ * skipping any that aren't needed; the lock on the catch-up tile frames
+ * is never held along with any other.
+ */
+class Room
+{
+	private:
+		std::string m_name;
+		std::string m_filename;
+		std::string m_checkpointFilename;
+
+		UpdateLog *m_updates;
+		Image *m_image;
+		CanvasSaver *m_saver;
+		Journal *m_journal;
+
+		// a lock for each tile of the canvas, and the id of the last
+		// update drawn in each tile, which is guarded by the tile's lock
+		Mutex *m_tileLocks;
+		std::vector <int> m_tileVersions;
+		unsigned int m_tileColumns, m_tileRows;
+
+		// guards the save and activity times
+		Mutex m_mutex;
+		long m_lastSaveTime;
+		long m_lastActiveTime;
+
+		Mutex m_subscriberMutex;
+		std::set <PaintContext *> m_subscribers;
+		volatile int m_userCount;
+
+		// the number of requests and connections using the room;
+		// rooms are only evicted when nothing is using them
+		volatile int m_pins;
+
+		// the canvas encoded as a PNG, along with the modification
+		// serial and last update id it was encoded at
+		Mutex m_canvasMutex;
+		PngEncoder m_canvasEncoder;
+		SharedBuffer m_canvasPng;
+		unsigned int m_canvasPngSerial;
+		int m_canvasPngUpdateId;
+		std::string m_canvasPngTagPrefix;
+
+		// catch-up frames for clients too far behind to be sent the
+		// updates they missed: the whole canvas as of the PNG above,
+		// and each tile as of the version it was encoded at
+		SharedBuffer m_canvasFrame;
+		unsigned int m_canvasFrameSerial;
+		Mutex m_tileFrameMutex;
+		std::vector <SharedBuffer> m_tileFrames;
+		std::vector <int> m_tileFrameVersions;
+		volatile unsigned long m_tileCatchUps;
+		volatile unsigned long m_canvasCatchUps;
+		volatile unsigned long m_catchUpTiles;
+
+		void lockTiles(int left, int top, int right, int bottom);
+		void unlockTiles(int left, int top, int right, int bottom);
+		void markTiles(int left, int top, int right, int bottom, int updateId);
+		void markStroke(const PaintUpdate &update, int margin);
+		Image *snapshot(int *updateId);
+		Image *checkpoint();
+		void encodeCanvasPng(Image *snapshot, int updateId);
+		int catchUp(int afterId, std::vector <SharedBuffer> &frames);
+		void notifySubscribers();
+
+	public:
+		Room(const std::string &name, const std::string &filename, const std::string &tagPrefix,
+		     const PngEncoder::Settings &pngSettings);
+		virtual ~Room();
+
+		void updateImage(long time);
+		void renderUpdate(PaintUpdate &update, Painter *painter);
+		void renderUpdates(const std::vector <PaintUpdate *> &updates, TileRenderer *renderer);
+		void publish(long time);
+		int getUpdates(int userId, int userLastUpdateId, bool binary, std::vector <SharedBuffer> &frames);
+		SharedBuffer getCanvasPng(std::string &tag, int *updateId);
+		int getTiles(const std::string &epoch, int updateId, std::vector <SharedBuffer> &frames);
+
+		void subscribe(PaintContext *context);
+		void unsubscribe(PaintContext *context);
+		void markKeepalives();
+
+		void pin();
+		void unpin();
+		int getPinCount() const;
+
+		const std::string &getEpoch() const;
+		const std::string &getName() const;
+		int getUpdateId() const;
+		int getUserCount() const;
+		long getLastActiveTime();
+		unsigned long getTileCatchUps() const;
+		unsigned long getCanvasCatchUps() const;
+		unsigned long getCatchUpTiles() const;
+		const PngEncoder *getCanvasEncoder() const;
+		CanvasSaver *getSaver() const;
+		Journal *getJournal() const;
+};
+
+#endif /* __ROOM_H__ */
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <xviweb/String.h>
+#include "Exception.h"
+#include "RoomTable.h"
+#include "Util.h"
+
+// the default room's canvas; other rooms are kept in "Canvas-<room>.png"
+const char *CANVAS_PATH = "Canvas.png";
+
+using namespace std;
+
+RoomTable::RoomTable(const PngEncoder::Settings &pngSettings,
+                     unsigned int maxRooms, long idleTime)
+{
+	m_pngSettings = pngSettings;
+	m_maxRooms = maxRooms;
+	m_idleTime = idleTime;
+
+	m_loads = 0;
+	m_startTime = String::fromInt((int)(getMilliseconds() / 1000));
+}
+
+RoomTable::~RoomTable()
+{
+	// write out every loaded room
+	for(unsigned int i = 0; i < SHARDS; ++i) {
+		map <string, Room *> &rooms = m_shards[i].rooms;
+		for(map <string, Room *>::iterator j = rooms.begin(); j != rooms.end(); ++j)
+			delete j->second;
+		rooms.clear();
+	}
+}
+
+RoomTable::Shard &
+RoomTable::getShard(const string &name)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < name.length(); ++i)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+	return m_shards[hash % SHARDS];
+}
+
+/*
+ * Clears the busy mark of a name once it has been loaded or evicted,
+ * and wakes the lookups waiting for it.
+ */
+void
+RoomTable::release(const string &name)
+{
+	Shard &shard = getShard(name);
+	MutexLocker locker(&shard.mutex);
+	shard.busy.erase(name);
+	shard.condition.broadcast();
+}
+
+/*
+ * Returns the named room, loading it if it isn't loaded. The room is
+ * returned pinned, so it isn't evicted until the caller unpins it. The
+ * empty name is the default room.
+ */
+Room *
+RoomTable::getRoom(const string &name)
+{
+	Shard &shard = getShard(name);
+	shard.mutex.lock();
+	while(shard.busy.find(name) != shard.busy.end())
+		shard.condition.wait(&shard.mutex);
+
+	map <string, Room *>::iterator i = shard.rooms.find(name);
+	if(i != shard.rooms.end()) {
+		Room *room = i->second;
+		room->pin();
+		shard.mutex.unlock();
+		return room;
+	}
+
+	shard.busy.insert(name);
+	shard.mutex.unlock();
+
+	Room *room;
+	string filename = name.empty() ? string(CANVAS_PATH) : "Canvas-" + name + ".png";
+	string tagPrefix = m_startTime + "-" + String::fromInt(__sync_add_and_fetch(&m_loads, 1));
+	try {
+		room = new Room(name, filename, tagPrefix, m_pngSettings);
+	} catch(Exception &ex) {
+		release(name);
+		throw;
+	}
+
+	shard.mutex.lock();
+	shard.rooms[name] = room;
+	room->pin();
+	shard.busy.erase(name);
+	shard.condition.broadcast();
+	shard.mutex.unlock();
+
+	return room;
+}
+
+unsigned int
+RoomTable::getRoomCount()
+{
+	unsigned int count = 0;
+	for(unsigned int i = 0; i < SHARDS; ++i) {
+		MutexLocker locker(&m_shards[i].mutex);
+		count += m_shards[i].rooms.size();
+	}
+
+	return count;
+}
+
+/*
+ * Writes out and unloads rooms nothing is using that have been idle
+ * for the idle time, then the least recently used unused rooms until
+ * no more than the maximum number are loaded. Rooms are taken out of
+ * their shards and marked busy under the shard locks; writing them out
+ * happens after the locks are released, and the busy marks are only
+ * cleared once it has finished, so a room can't be loaded again from
+ * files it's still writing. Returns the number of rooms evicted.
+ */
+unsigned int
+RoomTable::evictRooms(long time)
+{
+	vector < pair <long, Room *> > idle;
+	vector <Room *> evicted;
+	unsigned int count = 0;
+
+	for(unsigned int i = 0; i < SHARDS; ++i) {
+		MutexLocker locker(&m_shards[i].mutex);
+		map <string, Room *> &rooms = m_shards[i].rooms;
+		for(map <string, Room *>::iterator j = rooms.begin(); j != rooms.end();) {
+			Room *room = (j++)->second;
+			if(room->getPinCount() != 0) {
+				++count;
+				continue;
+			}
+
+			long lastActiveTime = room->getLastActiveTime();
+			if(time - lastActiveTime > m_idleTime) {
+				rooms.erase(room->getName());
+				m_shards[i].busy.insert(room->getName());
+				evicted.push_back(room);
+			} else {
+				idle.push_back(make_pair(lastActiveTime, room));
+				++count;
+			}
+		}
+	}
+
+	if(count > m_maxRooms) {
+		sort(idle.begin(), idle.end());
+		for(size_t i = 0; i < idle.size() && count > m_maxRooms; ++i) {
+			// the room may have been pinned or evicted since it was seen
+			Room *room = idle[i].second;
+			Shard &shard = getShard(room->getName());
+			MutexLocker locker(&shard.mutex);
+			map <string, Room *>::iterator j = shard.rooms.find(room->getName());
+			if(j == shard.rooms.end() || j->second != room || room->getPinCount() != 0)
+				continue;
+
+			shard.rooms.erase(j);
+			shard.busy.insert(room->getName());
+			evicted.push_back(room);
+			--count;
+		}
+	}
+
+	for(size_t i = 0; i < evicted.size(); ++i) {
+		string name = evicted[i]->getName();
+		delete evicted[i];
+		release(name);
+	}
+
+	return evicted.size();
+}
+
+/*
+ * Gets every loaded room, pinned so that none are evicted while
+ * the caller uses them.
+ */
+void
+RoomTable::getPinnedRooms(vector <Room *> &rooms)
+{
+	rooms.clear();
+	for(unsigned int i = 0; i < SHARDS; ++i) {
+		MutexLocker locker(&m_shards[i].mutex);
+		map <string, Room *> &shardRooms = m_shards[i].rooms;
+		for(map <string, Room *>::iterator j = shardRooms.begin(); j != shardRooms.end(); ++j) {
+			j->second->pin();
+			rooms.push_back(j->second);
+		}
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROOMTABLE_H__
+#define __ROOMTABLE_H__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "PngEncoder.h"
+#include "Room.h"
+#include "Thread.h"
+
+/*
+ * The loaded rooms, by name. A room is loaded when it's first looked
+ * up and evicted once nothing is using it and it has been idle for a
+ * while, or sooner if too many rooms are loaded. Evicting a room writes
+ * it out, so it's only done by evictRooms, which the responder's sweep
+ * calls; a lookup never waits for other rooms to be written out.
+ *
+ * Rooms are spread over shards by the hash of their name, so lookups
+ * in different shards don't contend. Loading and evicting a room read
+ * and write its files, so both are done with the shard unlocked. The
+ * name is marked busy meanwhile, and lookups of it wait until the load
+ * or eviction has finished; two instances of a room never exist at
+ * once, since they would share the room's journal.
+ */
+class RoomTable
+{
+	private:
+		class Shard
+		{
+			public:
+				Mutex mutex;
+				Condition condition;
+				std::map <std::string, Room *> rooms;
+				std::set <std::string> busy;
+		};
+
+		static const unsigned int SHARDS = 16;
+		Shard m_shards[SHARDS];
+
+		PngEncoder::Settings m_pngSettings;
+		unsigned int m_maxRooms;
+		long m_idleTime;
+
+		volatile int m_loads;
+		std::string m_startTime;
+
+		Shard &getShard(const std::string &name);
+		void release(const std::string &name);
+
+	public:
+		RoomTable(const PngEncoder::Settings &pngSettings, unsigned int maxRooms, long idleTime);
+		virtual ~RoomTable();
+
+		Room *getRoom(const std::string &name);
+		unsigned int evictRooms(long time);
+		void getPinnedRooms(std::vector <Room *> &rooms);
+		unsigned int getRoomCount();
+};
+
+#endif /* __ROOMTABLE_H__ */
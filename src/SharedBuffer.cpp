@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SharedBuffer.h"
+
+using namespace std;
+
+SharedBuffer::SharedBuffer()
+{
+	m_data = NULL;
+}
+
+SharedBuffer::SharedBuffer(const string &bytes)
+{
+	m_data = new Data;
+	m_data->refCount = 1;
+	m_data->bytes = bytes;
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &buffer)
+{
+	m_data = buffer.m_data;
+	if(m_data)
+		__sync_add_and_fetch(&m_data->refCount, 1);
+}
+
+SharedBuffer::~SharedBuffer()
+{
+	release();
+}
+
+void
+SharedBuffer::release()
+{
+	if(m_data && __sync_sub_and_fetch(&m_data->refCount, 1) == 0)
+		delete m_data;
+	m_data = NULL;
+}
+
+SharedBuffer &
+SharedBuffer::operator = (const SharedBuffer &buffer)
+{
+	if(buffer.m_data)
+		__sync_add_and_fetch(&buffer.m_data->refCount, 1);
+	release();
+	m_data = buffer.m_data;
+
+	return *this;
+}
+
+const string &
+SharedBuffer::getString() const
+{
+	static const string empty;
+	return m_data ? m_data->bytes : empty;
+}
+
+size_t
+SharedBuffer::getLength() const
+{
+	return m_data ? m_data->bytes.length() : 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <cmath>
+#include "Encoding.h"
+#include "Stroke.h"
+
+using namespace std;
+
+/*
+ * Adds a segment, continuing the last polyline if the
+ * segment starts at the point where the polyline ends.
+ */
+void
+Stroke::addSegment(int16_t x1, int16_t y1, int16_t x2, int16_t y2)
+{
+	size_t size = m_points.size();
+	if(size == 0 || m_points[size - 2] != x1 || m_points[size - 1] != y1) {
+		m_polylines.push_back(size / 2);
+		m_points.push_back(x1);
+		m_points.push_back(y1);
+	}
+
+	m_points.push_back(x2);
+	m_points.push_back(y2);
+}
+
+/*
+ * Validates and parses the text form of a stroke in a single pass.
+ * Every segment must have exactly four coordinates, and every coordinate
+ * must be a non-empty run of digits no greater than 32767. Returns false,
+ * leaving the stroke empty, if the text is invalid.
+ */
+bool
+Stroke::parse(const char *s, size_t length)
+{
+	m_points.clear();
+	m_polylines.clear();
+	m_points.reserve((length / 8) + 4);
+
+	const char *end = s + length;
+	int16_t coords[4];
+	int coord = 0;
+	while(true) {
+		// read a coordinate
+		int value = 0;
+		const char *start = s;
+		while(s != end && *s >= '0' && *s <= '9') {
+			value = (value * 10) + (*s++ - '0');
+			if(value > 32767)
+				break;
+		}
+		if(s == start || value > 32767)
+			break;
+		coords[coord] = (int16_t)value;
+
+		// coordinates are separated by commas and
+		// segments by semicolons after the fourth
+		if(++coord == 4) {
+			coord = 0;
+			addSegment(coords[0], coords[1], coords[2], coords[3]);
+			if(s == end)
+				return true;
+			if(*s++ != ';')
+				break;
+		} else if(s == end || *s++ != ',') {
+			break;
+		}
+	}
+
+	m_points.clear();
+	m_polylines.clear();
+	return false;
+}
+
+bool
+Stroke::parse(const string &s)
+{
+	return parse(s.data(), s.length());
+}
+
+/*
+ * Appends the text form of the stroke to s.
+ */
+void
+Stroke::format(string &s) const
+{
+	char buf[32];
+	const char *separator = "";
+	for(unsigned int i = 0; i < getPolylineCount(); ++i) {
+		unsigned int count;
+		const int16_t *points = getPolyline(i, &count);
+
+		// a dot is a segment that starts and ends at the same point
+		unsigned int segments = (count == 1) ? 1 : count - 1;
+		for(unsigned int j = 0; j < segments; ++j) {
+			const int16_t *p = points + (j * 2);
+			const int16_t *q = (count == 1) ? p : p + 2;
+			int length = snprintf(buf, sizeof(buf), "%s%d,%d,%d,%d", separator,
+			                      p[0], p[1], q[0], q[1]);
+			s.append(buf, length);
+			separator = ";";
+		}
+	}
+}
+
+/*
+ * Decodes the binary form of a stroke, which must take up all of the
+ * given bytes. Returns false, leaving the stroke empty, if the data is
+ * invalid or a point falls outside of 0 to 32767.
+ */
+bool
+Stroke::decode(const unsigned char *p, const unsigned char *end)
+{
+	m_points.clear();
+	m_polylines.clear();
+	m_points.reserve((end - p) * 2);
+
+	int32_t x = 0, y = 0;
+	while(p != end) {
+		uint32_t count;
+		if(!readVarint(p, end, count) || count == 0 || count > (uint32_t)(end - p))
+			break;
+
+		m_polylines.push_back(m_points.size() / 2);
+		uint32_t i;
+		for(i = 0; i < count; ++i) {
+			int32_t dx, dy;
+			if(!readSignedVarint(p, end, dx) || !readSignedVarint(p, end, dy) ||
+			   dx < -32767 || dx > 32767 || dy < -32767 || dy > 32767)
+				break;
+
+			x += dx;
+			y += dy;
+			if(x < 0 || x > 32767 || y < 0 || y > 32767)
+				break;
+
+			m_points.push_back((int16_t)x);
+			m_points.push_back((int16_t)y);
+		}
+		if(i != count)
+			break;
+	}
+
+	if(p == end)
+		return true;
+
+	m_points.clear();
+	m_polylines.clear();
+	return false;
+}
+
+/*
+ * Appends the binary form of the stroke to bytes.
+ */
+void
+Stroke::encode(string &bytes) const
+{
+	int32_t x = 0, y = 0;
+	for(unsigned int i = 0; i < getPolylineCount(); ++i) {
+		unsigned int count;
+		const int16_t *points = getPolyline(i, &count);
+
+		appendVarint(bytes, count);
+		for(unsigned int j = 0; j < count * 2; j += 2) {
+			appendSignedVarint(bytes, points[j] - x);
+			appendSignedVarint(bytes, points[j + 1] - y);
+			x = points[j];
+			y = points[j + 1];
+		}
+	}
+}
+
+/*
+ * Marks the points of the polyline from start to end (point indices,
+ * end inclusive) that Ramer-Douglas-Peucker simplification keeps.
+ * The endpoints are always kept; between them, the point farthest from
+ * the line through the endpoints is kept if it's farther than
+ * tolerance, and the two halves are simplified in turn. The halves are kept on a stack rather than
+ * recursed into, so long polylines can't exhaust the call stack.
+ */
+void
+Stroke::simplifyPolyline(unsigned int start, unsigned int end, float tolerance,
+                         vector <bool> &keep, vector <unsigned int> &stack) const
+{
+	keep[start] = true;
+	keep[end] = true;
+
+	stack.clear();
+	stack.push_back(start);
+	stack.push_back(end);
+	while(!stack.empty()) {
+		unsigned int last = stack.back();
+		stack.pop_back();
+		unsigned int first = stack.back();
+		stack.pop_back();
+		if(last - first < 2)
+			continue;
+
+		float x1 = m_points[first * 2], y1 = m_points[first * 2 + 1];
+		float dx = m_points[last * 2] - x1, dy = m_points[last * 2 + 1] - y1;
+		float length = sqrtf((dx * dx) + (dy * dy));
+
+		// find the point farthest from the line through the
+		// endpoints, or from the first point if they're the same
+		float farthest = 0.0f;
+		unsigned int index = first;
+		for(unsigned int i = first + 1; i < last; ++i) {
+			float px = m_points[i * 2] - x1, py = m_points[i * 2 + 1] - y1;
+			float distance;
+			if(length == 0.0f)
+				distance = sqrtf((px * px) + (py * py));
+			else
+				distance = fabsf((px * dy) - (py * dx)) / length;
+
+			if(distance > farthest) {
+				farthest = distance;
+				index = i;
+			}
+		}
+
+		if(farthest > tolerance) {
+			keep[index] = true;
+			stack.push_back(first);
+			stack.push_back(index);
+			stack.push_back(index);
+			stack.push_back(last);
+		}
+	}
+}
+
+/*
+ * Drops points that are within tolerance pixels of the lines the
+ * remaining points make, leaving the ends of every polyline in place.
+ */
+void
+Stroke::simplify(float tolerance)
+{
+	unsigned int pointCount = getPointCount();
+	vector <bool> keep(pointCount, true);
+	vector <unsigned int> stack;
+
+	for(unsigned int i = 0; i < getPolylineCount(); ++i) {
+		unsigned int count;
+		getPolyline(i, &count);
+		if(count <= 2)
+			continue;
+
+		unsigned int start = m_polylines[i];
+		for(unsigned int j = start; j < start + count; ++j)
+			keep[j] = false;
+		// only the points simplification marks are kept
+		simplifyPolyline(start, start + count - 1, tolerance, keep, stack);
+	}
+
+	// move the kept points down over the dropped ones
+	unsigned int out = 0;
+	unsigned int polyline = 0;
+	for(unsigned int i = 0; i < pointCount; ++i) {
+		if(polyline < m_polylines.size() && m_polylines[polyline] == i)
+			m_polylines[polyline++] = out;
+		if(!keep[i])
+			continue;
+
+		m_points[out * 2] = m_points[i * 2];
+		m_points[out * 2 + 1] = m_points[i * 2 + 1];
+		++out;
+	}
+	m_points.resize(out * 2);
+}
+
+unsigned int
+Stroke::getPointCount() const
+{
+	return m_points.size() / 2;
+}
+
+/*
+ * Gets the smallest rectangle holding every point of the stroke.
+ * Returns false if the stroke is empty.
+ */
+bool
+Stroke::getBounds(int *left, int *top, int *right, int *bottom) const
+{
+	if(m_points.empty())
+		return false;
+
+	*left = *right = m_points[0];
+	*top = *bottom = m_points[1];
+	for(size_t i = 2; i < m_points.size(); i += 2) {
+		if(m_points[i] < *left)
+			*left = m_points[i];
+		if(m_points[i] > *right)
+			*right = m_points[i];
+		if(m_points[i + 1] < *top)
+			*top = m_points[i + 1];
+		if(m_points[i + 1] > *bottom)
+			*bottom = m_points[i + 1];
+	}
+
+	return true;
+}
+
+unsigned int
+Stroke::getPolylineCount() const
+{
+	return m_polylines.size();
+}
+
+/*
+ * Returns the x, y pairs of the given polyline, setting
+ * pointCount to the number of points in it.
+ */
+const int16_t *
+Stroke::getPolyline(unsigned int index, unsigned int *pointCount) const
+{
+	unsigned int end = (index + 1 < m_polylines.size()) ? m_polylines[index + 1] : m_points.size() / 2;
+	*pointCount = end - m_polylines[index];
+	return &m_points[m_polylines[index] * 2];
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __STROKE_H__
+#define __STROKE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * The lines making up an update, stored as polylines: runs of segments
+ * that each start where the one before ended share their endpoints, so
+ * every point is kept once. A polyline of a single point is a dot.
+ *
+ * The text form lists every segment, as "x1,y1,x2,y2;x1,y1,x2,y2;...".
+ *
+ * In the binary form, each polyline is a varint point count followed
+ * by the points, each as zig-zag varint x and y deltas from the point
+ * before it (the first point of the stroke is relative to 0, 0).
+ */
+class Stroke
+{
+	private:
+		// x, y pairs, and the index in m_points
+		// of the first point of each polyline
+		std::vector <int16_t> m_points;
+		std::vector <unsigned int> m_polylines;
+
+		void addSegment(int16_t x1, int16_t y1, int16_t x2, int16_t y2);
+		void simplifyPolyline(unsigned int start, unsigned int end, float tolerance,
+		                      std::vector <bool> &keep, std::vector <unsigned int> &stack) const;
+
+	public:
+		bool parse(const char *s, size_t length);
+		bool parse(const std::string &s);
+		void format(std::string &s) const;
+
+		bool decode(const unsigned char *p, const unsigned char *end);
+		void encode(std::string &bytes) const;
+
+		void simplify(float tolerance);
+
+		unsigned int getPointCount() const;
+		bool getBounds(int *left, int *top, int *right, int *bottom) const;
+
+		unsigned int getPolylineCount() const;
+		const int16_t *getPolyline(unsigned int index, unsigned int *pointCount) const;
+};
+
+#endif /* __STROKE_H__ */
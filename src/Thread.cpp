@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Exception.h"
+#include "Thread.h"
+
+/*
+ * Mutex
+ */
+Mutex::Mutex()
+{
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+Mutex::~Mutex()
+{
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void
+Mutex::lock()
+{
+	pthread_mutex_lock(&m_mutex);
+}
+
+void
+Mutex::unlock()
+{
+	pthread_mutex_unlock(&m_mutex);
+}
+
+/*
+ * MutexLocker
+ */
+MutexLocker::MutexLocker(Mutex *mutex)
+{
+	m_mutex = mutex;
+	m_mutex->lock();
+}
+
+MutexLocker::~MutexLocker()
+{
+	m_mutex->unlock();
+}
+
+/*
+ * ReadWriteLock
+ */
+ReadWriteLock::ReadWriteLock()
+{
+	pthread_rwlock_init(&m_lock, NULL);
+}
+
+ReadWriteLock::~ReadWriteLock()
+{
+	pthread_rwlock_destroy(&m_lock);
+}
+
+void
+ReadWriteLock::lockRead()
+{
+	pthread_rwlock_rdlock(&m_lock);
+}
+
+void
+ReadWriteLock::lockWrite()
+{
+	pthread_rwlock_wrlock(&m_lock);
+}
+
+void
+ReadWriteLock::unlock()
+{
+	pthread_rwlock_unlock(&m_lock);
+}
+
+/*
+ * Condition
+ */
+Condition::Condition()
+{
+	pthread_cond_init(&m_cond, NULL);
+}
+
+Condition::~Condition()
+{
+	pthread_cond_destroy(&m_cond);
+}
+
+void
+Condition::wait(Mutex *mutex)
+{
+	pthread_cond_wait(&m_cond, &mutex->m_mutex);
+}
+
+void
+Condition::signal()
+{
+	pthread_cond_signal(&m_cond);
+}
+
+void
+Condition::broadcast()
+{
+	pthread_cond_broadcast(&m_cond);
+}
+
+/*
+ * Thread
+ */
+Thread::Thread()
+{
+	m_started = false;
+}
+
+Thread::~Thread()
+{
+}
+
+void *
+Thread::threadMain(void *arg)
+{
+	((Thread *)arg)->run();
+	return NULL;
+}
+
+void
+Thread::start()
+{
+	if(m_started)
+		throw Exception("Thread::start(): Thread has already been started");
+
+	if(pthread_create(&m_thread, NULL, threadMain, this) != 0)
+		throw Exception("Thread::start(): pthread_create failed");
+	m_started = true;
+}
+
+void
+Thread::join()
+{
+	if(m_started) {
+		pthread_join(m_thread, NULL);
+		m_started = false;
+	}
+}
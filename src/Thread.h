@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include <pthread.h>
+
+class Mutex
+{
+	private:
+		pthread_mutex_t m_mutex;
+
+		friend class Condition;
+
+	public:
+		Mutex();
+		virtual ~Mutex();
+
+		void lock();
+		void unlock();
+};
+
+/*
+ * Locks a mutex for as long as the locker is in scope.
+ */
+class MutexLocker
+{
+	private:
+		Mutex *m_mutex;
+
+	public:
+		MutexLocker(Mutex *mutex);
+		virtual ~MutexLocker();
+};
+
+/*
+ * A lock that any number of readers can hold at once,
+ * or a single writer can hold to the exclusion of all.
+ */
+class ReadWriteLock
+{
+	private:
+		pthread_rwlock_t m_lock;
+
+	public:
+		ReadWriteLock();
+		virtual ~ReadWriteLock();
+
+		void lockRead();
+		void lockWrite();
+		void unlock();
+};
+
+class Condition
+{
+	private:
+		pthread_cond_t m_cond;
+
+	public:
+		Condition();
+		virtual ~Condition();
+
+		void wait(Mutex *mutex);
+		void signal();
+		void broadcast();
+};
+
+/*
+ * A thread of execution; subclasses implement run().
+ */
+class Thread
+{
+	private:
+		pthread_t m_thread;
+		bool m_started;
+
+		static void *threadMain(void *arg);
+
+	protected:
+		virtual void run() = 0;
+
+	public:
+		Thread();
+		virtual ~Thread();
+
+		void start();
+		void join();
+};
+
+#endif /* __THREAD_H__ */
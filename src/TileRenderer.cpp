@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include "TileRenderer.h"
+
+using namespace std;
+
+TileRenderer::Worker::Worker(TileRenderer *renderer, unsigned int index)
+{
+	m_renderer = renderer;
+	m_index = index;
+	painter = new Painter();
+}
+
+TileRenderer::Worker::~Worker()
+{
+	delete painter;
+}
+
+void
+TileRenderer::Worker::run()
+{
+	unsigned int generation = 0;
+
+	while(true) {
+		// wait for a new run of updates to be handed out
+		m_renderer->m_mutex.lock();
+		while(m_renderer->m_generation == generation && !m_renderer->m_stopping)
+			m_renderer->m_startCondition.wait(&m_renderer->m_mutex);
+		generation = m_renderer->m_generation;
+		bool stopping = m_renderer->m_stopping;
+		m_renderer->m_mutex.unlock();
+
+		if(stopping)
+			break;
+
+		m_renderer->work(m_index);
+	}
+}
+
+TileRenderer::TileRenderer(unsigned int threads)
+{
+	m_image = NULL;
+	m_columns = 0;
+	m_rows = 0;
+	m_remaining = 0;
+	m_generation = 0;
+	m_stopping = false;
+
+	if(threads == 0)
+		threads = 1;
+	for(unsigned int i = 0; i < threads; ++i)
+		m_workers.push_back(new Worker(this, i));
+	for(unsigned int i = 1; i < threads; ++i)
+		m_workers[i]->start();
+}
+
+TileRenderer::~TileRenderer()
+{
+	m_mutex.lock();
+	m_stopping = true;
+	m_startCondition.broadcast();
+	m_mutex.unlock();
+
+	for(unsigned int i = 0; i < m_workers.size(); ++i) {
+		m_workers[i]->join();
+		delete m_workers[i];
+	}
+}
+
+/*
+ * Adds each pass the painter would make over the update's polylines to
+ * the bins of the tiles it can reach, allowing for the brush.
+ */
+void
+TileRenderer::binPasses(const PaintUpdate *update)
+{
+	if(!Painter::isValidBrushSize(update->brushSize))
+		return;
+
+	Pass pass;
+	pass.brushSize = update->brushSize;
+	pass.brushColor = update->brushColor;
+
+	int lastColumn = (int)m_columns - 1;
+	int lastRow = (int)m_rows - 1;
+
+	for(unsigned int i = 0; i < update->stroke.getPolylineCount(); ++i) {
+		unsigned int count;
+		const int16_t *points = update->stroke.getPolyline(i, &count);
+
+		// each pass after the first starts at the last point of the one before
+		unsigned int start = 0;
+		do {
+			unsigned int length = (count == 1) ? 1 : Painter::getPassLength(points + (start * 2), count - start);
+			pass.points = points + (start * 2);
+			pass.count = length;
+
+			int left = pass.points[0], right = pass.points[0];
+			int top = pass.points[1], bottom = pass.points[1];
+			for(unsigned int j = 1; j < length; ++j) {
+				left = min(left, (int)pass.points[j * 2]);
+				right = max(right, (int)pass.points[j * 2]);
+				top = min(top, (int)pass.points[(j * 2) + 1]);
+				bottom = max(bottom, (int)pass.points[(j * 2) + 1]);
+			}
+
+			int firstColumn = max(left - pass.brushSize, 0) / (int)TILE_SIZE;
+			int firstRow = max(top - pass.brushSize, 0) / (int)TILE_SIZE;
+			int endColumn = min((right + pass.brushSize) / (int)TILE_SIZE, lastColumn);
+			int endRow = min((bottom + pass.brushSize) / (int)TILE_SIZE, lastRow);
+			for(int row = firstRow; row <= endRow; ++row) {
+				for(int column = firstColumn; column <= endColumn; ++column)
+					m_bins[(row * m_columns) + column].push_back(pass);
+			}
+
+			start += length - 1;
+		} while(start + 1 < count);
+	}
+}
+
+/*
+ * Takes a tile to draw, from the worker's own queue if it has any,
+ * or else from another worker's. Returns false if none are left.
+ */
+bool
+TileRenderer::takeTile(unsigned int index, unsigned int *tile)
+{
+	Worker *worker = m_workers[index];
+	bool found = false;
+
+	worker->mutex.lock();
+	if(!worker->tiles.empty()) {
+		*tile = worker->tiles.back();
+		worker->tiles.pop_back();
+		found = true;
+	}
+	worker->mutex.unlock();
+
+	for(unsigned int i = 1; !found && i < m_workers.size(); ++i) {
+		Worker *victim = m_workers[(index + i) % m_workers.size()];
+		victim->mutex.lock();
+		if(!victim->tiles.empty()) {
+			*tile = victim->tiles.front();
+			victim->tiles.pop_front();
+			found = true;
+		}
+		victim->mutex.unlock();
+	}
+
+	return found;
+}
+
+void
+TileRenderer::drawTile(Painter *painter, unsigned int tile)
+{
+	int left = (int)((tile % m_columns) * TILE_SIZE);
+	int top = (int)((tile / m_columns) * TILE_SIZE);
+	painter->setClip(left, top, left + TILE_SIZE - 1, top + TILE_SIZE - 1);
+
+	vector <Pass> &passes = m_bins[tile];
+	for(size_t i = 0; i < passes.size(); ++i) {
+		Pass &pass = passes[i];
+		painter->drawPolyline(m_image, pass.points, pass.count, pass.brushColor, pass.brushSize);
+	}
+	passes.clear();
+
+	painter->clearClip();
+}
+
+/*
+ * Draws tiles until there are none left to take.
+ */
+void
+TileRenderer::work(unsigned int index)
+{
+	unsigned int tile;
+
+	while(takeTile(index, &tile)) {
+		drawTile(m_workers[index]->painter, tile);
+
+		if(__sync_sub_and_fetch(&m_remaining, 1) == 0) {
+			m_mutex.lock();
+			m_doneCondition.broadcast();
+			m_mutex.unlock();
+		}
+	}
+}
+
+/*
+ * Draws the given updates on the image, in order. Only one thread may
+ * render at a time, and the caller must keep anything else from
+ * drawing on the tiles the updates can reach until this returns.
+ */
+void
+TileRenderer::render(Image *image, const vector <PaintUpdate *> &updates)
+{
+	m_image = image;
+	m_columns = (image->getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+	m_rows = (image->getHeight() + TILE_SIZE - 1) / TILE_SIZE;
+	m_bins.resize(m_columns * m_rows);
+
+	for(size_t i = 0; i < updates.size(); ++i)
+		binPasses(updates[i]);
+
+	vector <unsigned int> tiles;
+	for(unsigned int i = 0; i < m_bins.size(); ++i) {
+		if(!m_bins[i].empty())
+			tiles.push_back(i);
+	}
+	if(tiles.empty())
+		return;
+
+	// a single tile isn't worth waking the pool for
+	if(tiles.size() == 1 || m_workers.size() == 1) {
+		for(size_t i = 0; i < tiles.size(); ++i)
+			drawTile(m_workers[0]->painter, tiles[i]);
+		return;
+	}
+
+	// hand the tiles out to the workers in turn; the count is
+	// set before any can be taken, so it can't reach zero early
+	__sync_lock_test_and_set(&m_remaining, (int)tiles.size());
+	for(size_t i = 0; i < tiles.size(); ++i) {
+		Worker *worker = m_workers[i % m_workers.size()];
+		worker->mutex.lock();
+		worker->tiles.push_back(tiles[i]);
+		worker->mutex.unlock();
+	}
+
+	m_mutex.lock();
+	++m_generation;
+	m_startCondition.broadcast();
+	m_mutex.unlock();
+
+	work(0);
+
+	m_mutex.lock();
+	while(__sync_fetch_and_add(&m_remaining, 0) != 0)
+		m_doneCondition.wait(&m_mutex);
+	m_mutex.unlock();
+}
+
+unsigned int
+TileRenderer::getThreadCount() const
+{
+	return m_workers.size();
+}
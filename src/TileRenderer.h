@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TILERENDERER_H__
+#define __TILERENDERER_H__
+
+#include <deque>
+#include <vector>
+#include "Image.h"
+#include "Painter.h"
+#include "Thread.h"
+#include "UpdateLog.h"
+
+/*
+ * Draws a run of updates on an image using several threads. The image
+ * is divided into TILE_SIZE x TILE_SIZE tiles, and each pass the painter
+ * would make over a polyline is binned into every tile its bounds reach.
+ * Tiles are then drawn in parallel, each clipped to its own pixels with
+ * its passes in their original order, so the result is exactly what
+ * drawing the updates one after another would give.
+ *
+ * Tiles are handed out to per-thread queues; a thread that runs out of
+ * tiles steals from the front of another's queue. The thread calling
+ * render() works through tiles alongside the pool.
+ */
+class TileRenderer
+{
+	private:
+		class Pass
+		{
+			public:
+				const int16_t *points;
+				unsigned int count;
+				int brushSize;
+				Color brushColor;
+		};
+
+		class Worker : public Thread
+		{
+			private:
+				TileRenderer *m_renderer;
+				unsigned int m_index;
+
+			protected:
+				void run();
+
+			public:
+				Painter *painter;
+
+				// tiles waiting to be drawn; the owner takes
+				// from the back and thieves from the front
+				Mutex mutex;
+				std::deque <unsigned int> tiles;
+
+				Worker(TileRenderer *renderer, unsigned int index);
+				virtual ~Worker();
+		};
+
+		// the first worker is the thread calling render(),
+		// so it's never started
+		std::vector <Worker *> m_workers;
+
+		Image *m_image;
+		unsigned int m_columns, m_rows;
+		std::vector <std::vector <Pass> > m_bins;
+		volatile int m_remaining;
+
+		// workers wait on m_startCondition for the
+		// generation to change, and the caller waits on
+		// m_doneCondition for the last tile to be drawn
+		Mutex m_mutex;
+		Condition m_startCondition;
+		Condition m_doneCondition;
+		unsigned int m_generation;
+		bool m_stopping;
+
+		void binPasses(const PaintUpdate *update);
+		bool takeTile(unsigned int index, unsigned int *tile);
+		void drawTile(Painter *painter, unsigned int tile);
+		void work(unsigned int index);
+
+	public:
+		static const unsigned int TILE_SIZE = 2 * Image::TILE_SIZE;
+
+		TileRenderer(unsigned int threads);
+		virtual ~TileRenderer();
+
+		void render(Image *image, const std::vector <PaintUpdate *> &updates);
+		unsigned int getThreadCount() const;
+};
+
+#endif /* __TILERENDERER_H__ */
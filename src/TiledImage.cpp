@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include "Exception.h"
+#include "TiledImage.h"
+
+using namespace std;
+
+TiledImage::TiledImage(unsigned int width, unsigned int height,
+                       int colorComponents)
+{
+	m_width = width;
+	m_height = height;
+	m_colorComponents = colorComponents;
+	initTiles();
+
+	m_tiles.resize(m_tileColumns * m_tileRows);
+	for(unsigned int i = 0; i < m_tiles.size(); ++i) {
+		m_tiles[i] = createTile();
+		memset(m_tiles[i]->data, 255, TILE_SIZE * TILE_SIZE * m_colorComponents);
+	}
+}
+
+TiledImage::TiledImage(const Image *image)
+{
+	m_filename = image->getFilename();
+	m_width = image->getWidth();
+	m_height = image->getHeight();
+	m_colorComponents = image->getNumComponents();
+	initTiles();
+
+	m_tiles.resize(m_tileColumns * m_tileRows);
+	for(unsigned int i = 0; i < m_tiles.size(); ++i)
+		m_tiles[i] = createTile();
+
+	// copy the image into the tiles one row at a time
+	uint8_t *row = new uint8_t[m_width * m_colorComponents];
+	for(unsigned int y = 0; y < m_height; ++y) {
+		image->readRow(y, row);
+		for(unsigned int x = 0; x < m_width;) {
+			unsigned int length;
+			uint8_t *span = getSpan(x, y, &length);
+			memcpy(span, row + (x * m_colorComponents), length * m_colorComponents);
+			x += length;
+		}
+	}
+	delete [] row;
+}
+
+TiledImage::TiledImage(const TiledImage *image)
+{
+	m_filename = image->m_filename;
+	m_width = image->m_width;
+	m_height = image->m_height;
+	m_colorComponents = image->m_colorComponents;
+	initTiles();
+	m_serial = image->m_serial;
+	m_tileSerials = image->m_tileSerials;
+	m_text = image->m_text;
+
+	// share all of the tiles
+	m_tiles = image->m_tiles;
+	for(unsigned int i = 0; i < m_tiles.size(); ++i)
+		retainTile(m_tiles[i]);
+}
+
+TiledImage::~TiledImage()
+{
+	for(unsigned int i = 0; i < m_tiles.size(); ++i)
+		releaseTile(m_tiles[i]);
+}
+
+TiledImage::Tile *
+TiledImage::createTile() const
+{
+	Tile *tile = new Tile;
+	tile->refCount = 1;
+	tile->data = new uint8_t[TILE_SIZE * TILE_SIZE * m_colorComponents];
+
+	return tile;
+}
+
+void
+TiledImage::retainTile(Tile *tile)
+{
+	__sync_add_and_fetch(&tile->refCount, 1);
+}
+
+void
+TiledImage::releaseTile(Tile *tile)
+{
+	if(__sync_sub_and_fetch(&tile->refCount, 1) == 0) {
+		delete [] tile->data;
+		delete tile;
+	}
+}
+
+unsigned int
+TiledImage::getTileIndex(unsigned int x, unsigned int y) const
+{
+	return ((y / TILE_SIZE) * m_tileColumns) + (x / TILE_SIZE);
+}
+
+unsigned int
+TiledImage::getTileOffset(unsigned int x, unsigned int y) const
+{
+	return (((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * m_colorComponents;
+}
+
+const uint8_t *
+TiledImage::getSpan(unsigned int x, unsigned int y, unsigned int *length) const
+{
+	if(x >= m_width || y >= m_height)
+		throw Exception("TiledImage::getSpan(): Pixel is out of image bounds");
+
+	// spans end at the edge of the tile or the image
+	if(length) {
+		*length = TILE_SIZE - (x % TILE_SIZE);
+		if(*length > m_width - x)
+			*length = m_width - x;
+	}
+
+	return m_tiles[getTileIndex(x, y)]->data + getTileOffset(x, y);
+}
+
+uint8_t *
+TiledImage::getSpan(unsigned int x, unsigned int y, unsigned int *length)
+{
+	if(x >= m_width || y >= m_height)
+		throw Exception("TiledImage::getSpan(): Pixel is out of image bounds");
+
+	// give this image its own copy of the tile before handing out
+	// a writable pointer to it; snapshots release their tiles from
+	// other threads, so the count is read atomically
+	unsigned int index = getTileIndex(x, y);
+	Tile *tile = m_tiles[index];
+	if(__sync_fetch_and_add(&tile->refCount, 0) > 1) {
+		Tile *copy = createTile();
+		memcpy(copy->data, tile->data, TILE_SIZE * TILE_SIZE * m_colorComponents);
+		m_tiles[index] = copy;
+		releaseTile(tile);
+	}
+
+	return (uint8_t *)((const TiledImage *)this)->getSpan(x, y, length);
+}
+
+Image *
+TiledImage::snapshot() const
+{
+	return new TiledImage(this);
+}
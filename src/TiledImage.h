@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TILEDIMAGE_H__
+#define __TILEDIMAGE_H__
+
+#include <vector>
+#include "Image.h"
+
+/*
+ * An image stored as TILE_SIZE x TILE_SIZE tiles. Tiles are reference
+ * counted and shared copy-on-write between an image and its snapshots,
+ * so taking a snapshot only copies tile pointers, and drawing after a
+ * snapshot only copies the tiles it touches.
+ */
+class TiledImage : public Image
+{
+	private:
+		class Tile
+		{
+			public:
+				int refCount;
+				uint8_t *data;
+		};
+
+		std::vector <Tile *> m_tiles;
+
+		TiledImage(const TiledImage *image);
+
+		Tile *createTile() const;
+		static void retainTile(Tile *tile);
+		static void releaseTile(Tile *tile);
+
+		unsigned int getTileIndex(unsigned int x, unsigned int y) const;
+		unsigned int getTileOffset(unsigned int x, unsigned int y) const;
+
+	public:
+		TiledImage(unsigned int width, unsigned int height, int colorComponents);
+		TiledImage(const Image *image);
+		virtual ~TiledImage();
+
+		const uint8_t *getSpan(unsigned int x, unsigned int y, unsigned int *length) const;
+		uint8_t *getSpan(unsigned int x, unsigned int y, unsigned int *length);
+
+		Image *snapshot() const;
+};
+
+#endif /* __TILEDIMAGE_H__ */
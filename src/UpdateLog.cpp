@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <xviweb/String.h>
+#include "Encoding.h"
+#include "Exception.h"
+#include "UpdateLog.h"
+
+using namespace std;
+
+/*
+ * Decodes the binary form of an update. Returns false if it's invalid.
+ */
+bool
+PaintUpdate::decode(const string &bytes)
+{
+	const unsigned char *p = (const unsigned char *)bytes.data();
+	const unsigned char *end = p + bytes.length();
+
+	uint32_t size, color, user;
+	if(!readVarint(p, end, size) || !readUInt32(p, end, color) || !readVarint(p, end, user))
+		return false;
+	if(size > 0x7fffffff || user > 0x7fffffff)
+		return false;
+
+	brushSize = (int)size;
+	brushColor = Color(color);
+	userId = (int)user;
+	return stroke.decode(p, end);
+}
+
+void
+PaintUpdate::encode(string &bytes) const
+{
+	appendVarint(bytes, (uint32_t)brushSize);
+	appendUInt32(bytes, brushColor.toUInt32());
+	appendVarint(bytes, (uint32_t)userId);
+	stroke.encode(bytes);
+}
+
+UpdateLog::UpdateLog(unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1)) != 0)
+		throw Exception("UpdateLog::UpdateLog(): Capacity must be a power of two");
+
+	m_entries.resize(capacity);
+	m_mask = capacity - 1;
+
+	// the log starts out empty, with the first retained
+	// id being the one after the last id appended
+	m_firstId = 1;
+	m_lastId = 0;
+}
+
+UpdateLog::~UpdateLog()
+{
+}
+
+void
+UpdateLog::dropFirst()
+{
+	// release the update's data along with the entry
+	m_entries[m_firstId & m_mask] = PaintUpdate();
+	++m_firstId;
+}
+
+/*
+ * Appends an update, assigning it the next update id, which is
+ * returned, and building the frame sent to clients for it.
+ */
+int
+UpdateLog::append(PaintUpdate &update)
+{
+	char color[8];
+	snprintf(color, sizeof(color), "#%02x%02x%02x", update.brushColor.r, update.brushColor.g, update.brushColor.b);
+
+	m_lock.lockWrite();
+	if((unsigned int)(m_lastId - m_firstId + 1) == getCapacity())
+		dropFirst();
+
+	update.updateId = ++m_lastId;
+
+	string frame = String::fromInt(update.updateId);
+	frame += " " + String::fromInt(update.brushSize);
+	frame += " ";
+	frame += color;
+	frame += " ";
+	update.stroke.format(frame);
+	frame += "\n";
+	update.frame = SharedBuffer(frame);
+
+	// binary frames are the update id followed by the binary
+	// form of the update, sent as a base64 "b:" line
+	string bytes;
+	appendVarint(bytes, (uint32_t)update.updateId);
+	update.encode(bytes);
+	frame = "b:";
+	encodeBase64(bytes, frame);
+	frame += "\n";
+	update.binaryFrame = SharedBuffer(frame);
+
+	m_entries[m_lastId & m_mask] = update;
+	int updateId = m_lastId;
+	m_lock.unlock();
+
+	return updateId;
+}
+
+/*
+ * Drops updates more than maxAge milliseconds older than time.
+ */
+void
+UpdateLog::expire(long time, long maxAge)
+{
+	m_lock.lockWrite();
+	while(m_firstId <= m_lastId && (time - m_entries[m_firstId & m_mask].updateTime) > maxAge)
+		dropFirst();
+	m_lock.unlock();
+}
+
+int
+UpdateLog::getLastId() const
+{
+	m_lock.lockRead();
+	int lastId = m_lastId;
+	m_lock.unlock();
+
+	return lastId;
+}
+
+unsigned int
+UpdateLog::getSize() const
+{
+	m_lock.lockRead();
+	unsigned int size = (unsigned int)(m_lastId - m_firstId + 1);
+	m_lock.unlock();
+
+	return size;
+}
+
+unsigned int
+UpdateLog::getCapacity() const
+{
+	return m_mask + 1;
+}
+
+/*
+ * Gathers the frames of the updates after afterId that weren't made by
+ * userId, in binary or text, and sets lastId to the id of the last update
+ * looked at, which is where the next call should continue from; it's
+ * read along with the frames, so no update can be missed in between.
+ * Returns false, gathering nothing, if some of the updates after afterId
+ * are no longer retained, or afterId is past the last update.
+ */
+bool
+UpdateLog::getFrames(int userId, int afterId, bool binary,
+                     vector <SharedBuffer> &frames, int *lastId) const
+{
+	frames.clear();
+
+	m_lock.lockRead();
+	*lastId = m_lastId;
+	if(afterId + 1 < m_firstId || afterId > m_lastId) {
+		m_lock.unlock();
+		return false;
+	}
+
+	for(int updateId = afterId + 1; updateId <= m_lastId; ++updateId) {
+		const PaintUpdate &update = m_entries[updateId & m_mask];
+		if(update.userId != userId)
+			frames.push_back(binary ? update.binaryFrame : update.frame);
+	}
+	m_lock.unlock();
+
+	return true;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UPDATELOG_H__
+#define __UPDATELOG_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Color.h"
+#include "SharedBuffer.h"
+#include "Stroke.h"
+#include "Thread.h"
+
+/*
+ * An update posted by a user. The binary form of an update is the
+ * brush size as a varint, the brush color as a 32-bit RGBA value, the
+ * user id as a varint and then the binary form of the stroke.
+ */
+class PaintUpdate
+{
+	public:
+		long updateTime;
+		int updateId;
+		int userId;
+		int brushSize;
+		Color brushColor;
+		Stroke stroke;
+
+		// the update as sent to clients in the text and binary
+		// formats, serialized once when it's appended to the log
+		SharedBuffer frame;
+		SharedBuffer binaryFrame;
+
+		bool decode(const std::string &bytes);
+		void encode(std::string &bytes) const;
+};
+
+/*
+ * A fixed-capacity ring buffer of the most recent updates. Update ids
+ * are assigned by the log and increase by one with each update, so the
+ * entry for any retained id is found directly from the id, and expiring
+ * the oldest update is constant time. The capacity must be a power of
+ * two; when the log is full, appending drops the oldest update.
+ *
+ * The log is safe to use from multiple threads. Appending and expiring
+ * take its lock exclusively, while any number of readers can gather
+ * frames at once; readers only copy the frames' handles under the lock,
+ * and send them after releasing it.
+ */
+class UpdateLog
+{
+	private:
+		mutable ReadWriteLock m_lock;
+		std::vector <PaintUpdate> m_entries;
+		unsigned int m_mask;
+		int m_firstId;
+		int m_lastId;
+
+		void dropFirst();
+
+	public:
+		UpdateLog(unsigned int capacity);
+		virtual ~UpdateLog();
+
+		int append(PaintUpdate &update);
+		void expire(long time, long maxAge);
+
+		int getLastId() const;
+		unsigned int getSize() const;
+		unsigned int getCapacity() const;
+		bool getFrames(int userId, int afterId, bool binary, std::vector <SharedBuffer> &frames, int *lastId) const;
+};
+
+#endif /* __UPDATELOG_H__ */
@@ -24,9 +24,13 @@
  */
 
 #include <iostream>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include "Util.h"
 
+using namespace std;
+
 long
 getMilliseconds()
 {
@@ -35,3 +39,38 @@ getMilliseconds()
 		return 0;
 	return ((long)tv.tv_sec * 1000) + ((long)tv.tv_usec / 1000);
 }
+
+long
+getMicroseconds()
+{
+	struct timeval tv;
+	if(gettimeofday(&tv, NULL) == -1)
+		return 0;
+	return ((long)tv.tv_sec * 1000000) + (long)tv.tv_usec;
+}
+
+/*
+ * Flushes a file or directory to disk.
+ */
+bool
+syncPath(const string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	bool result = (fsync(fd) == 0);
+	close(fd);
+	return result;
+}
+
+/*
+ * Flushes the directory holding a file to disk, so
+ * that files created or renamed in it stay put.
+ */
+bool
+syncDirectoryOf(const string &path)
+{
+	size_t tmp = path.find_last_of('/');
+	return syncPath((tmp == string::npos) ? string(".") : path.substr(0, tmp + 1));
+}
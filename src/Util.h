@@ -26,6 +26,11 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include <string>
+
 long getMilliseconds();
+long getMicroseconds();
+bool syncPath(const std::string &path);
+bool syncDirectoryOf(const std::string &path);
 
 #endif /* __UTIL_H__ */
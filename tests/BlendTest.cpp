@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that every blend kernel the CPU can run gives exactly the same
+ * bytes as the scalar kernel, and that the scalar kernel rounds exactly.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Blend.h"
+#include "Test.h"
+
+using namespace std;
+
+class Kernel
+{
+	public:
+		const char *name;
+		BlendRowFunction function;
+
+		Kernel(const char *kernelName, BlendRowFunction kernelFunction)
+		{
+			name = kernelName;
+			function = kernelFunction;
+		}
+};
+
+static void
+getKernels(vector <Kernel> &kernels)
+{
+	kernels.push_back(Kernel("scalar", blendRowScalar));
+
+#ifdef BLEND_HAVE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		kernels.push_back(Kernel("sse2", blendRowSSE2));
+	else
+		printf("skipping sse2: not supported by this CPU\n");
+	if(__builtin_cpu_supports("avx2"))
+		kernels.push_back(Kernel("avx2", blendRowAVX2));
+	else
+		printf("skipping avx2: not supported by this CPU\n");
+#endif
+}
+
+/*
+ * Blends every combination of dest, source and alpha with each kernel
+ * and compares the result with the exactly rounded value.
+ */
+static void
+testExhaustive(const vector <Kernel> &kernels)
+{
+	uint8_t dest[256], source[256], alpha[256];
+	for(unsigned int i = 0; i < 256; ++i)
+		alpha[i] = (uint8_t)i;
+
+	for(size_t k = 0; k < kernels.size(); ++k) {
+		int wrong = 0;
+		for(unsigned int d = 0; d < 256; ++d) {
+			for(unsigned int s = 0; s < 256; ++s) {
+				memset(dest, (int)d, sizeof(dest));
+				memset(source, (int)s, sizeof(source));
+				kernels[k].function(dest, source, alpha, 256);
+
+				for(unsigned int a = 0; a < 256; ++a) {
+					unsigned int exact = (((s * a) + (d * (255 - a))) * 2 + 255) / 510;
+					if(dest[a] != exact)
+						++wrong;
+				}
+			}
+		}
+
+		if(wrong != 0)
+			printf("%s: %d of 16777216 blends are wrong\n", kernels[k].name, wrong);
+		TEST_CHECK(wrong == 0);
+	}
+}
+
+/*
+ * Blends random spans of random lengths and alignments, so that every
+ * kernel's tail handling is exercised, and compares each kernel's output
+ * with the scalar kernel's.
+ */
+static void
+testRandomSpans(const vector <Kernel> &kernels)
+{
+	const unsigned int MAX_LENGTH = 300;
+	const unsigned int MAX_OFFSET = 32;
+
+	vector <uint8_t> dest(MAX_LENGTH + MAX_OFFSET), source(MAX_LENGTH + MAX_OFFSET), alpha(MAX_LENGTH + MAX_OFFSET);
+	vector <uint8_t> expected(MAX_LENGTH), result(MAX_LENGTH + MAX_OFFSET);
+
+	srand(1);
+	for(unsigned int run = 0; run < 20000; ++run) {
+		// the short lengths cover every tail length of both vector widths
+		unsigned int length = (run < 2 * MAX_LENGTH) ? (run % MAX_LENGTH) : (unsigned int)(rand() % MAX_LENGTH);
+		unsigned int offset = (unsigned int)(rand() % MAX_OFFSET);
+
+		for(unsigned int i = 0; i < dest.size(); ++i) {
+			dest[i] = (uint8_t)rand();
+			source[i] = (uint8_t)rand();
+
+			// brush coverage is mostly fully on or off
+			int choice = rand() % 4;
+			alpha[i] = (choice == 0) ? 0 : (choice == 1) ? 255 : (uint8_t)rand();
+		}
+
+		memcpy(&expected[0], &dest[offset], length);
+		blendRowScalar(&expected[0], &source[offset], &alpha[offset], length);
+
+		for(size_t k = 1; k < kernels.size(); ++k) {
+			// the destination is misaligned differently from the source
+			unsigned int resultOffset = (offset * 7) % MAX_OFFSET;
+			memcpy(&result[resultOffset], &dest[offset], length);
+			kernels[k].function(&result[resultOffset], &source[offset], &alpha[offset], length);
+			if(memcmp(&result[resultOffset], &expected[0], length) != 0) {
+				printf("%s: differs from scalar for a span of %u at offset %u\n", kernels[k].name, length, offset);
+				TEST_CHECK(false);
+				return;
+			}
+		}
+	}
+}
+
+int
+main()
+{
+	vector <Kernel> kernels;
+	getKernels(kernels);
+
+	// the kernel used for drawing must be one of those checked
+	BlendRowFunction chosen = getBlendRowFunction();
+	bool found = false;
+	for(size_t i = 0; i < kernels.size(); ++i)
+		found = found || (kernels[i].function == chosen);
+	TEST_CHECK(found);
+
+	testExhaustive(kernels);
+	testRandomSpans(kernels);
+
+	return testResult();
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that a canvas is brought back up to date from its journal:
+ * with the last record torn off as by a crash, after the segments a
+ * saved canvas holds are discarded, and after writes fail because the
+ * file size limit is hit, so that the segment has to be cut back and
+ * written again.
+ *
+ * Run with the directory holding the brush images ("Images").
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <xviweb/String.h>
+#include "Journal.h"
+#include "Test.h"
+#include "TiledImage.h"
+#include "Util.h"
+
+using namespace std;
+
+const unsigned int WIDTH = 800;
+const unsigned int HEIGHT = 450;
+const unsigned int UPDATES = 60;
+
+static Painter *painter;
+
+static PaintUpdate
+makeUpdate(unsigned int index)
+{
+	int x = 20 + (int)((index * 37) % (WIDTH - 40));
+	int y = 20 + (int)((index * 23) % (HEIGHT - 40));
+
+	PaintUpdate update;
+	update.userId = (int)index;
+	update.brushSize = (index % 2 == 0) ? 8 : 16;
+	update.brushColor = Color((uint8_t)(index * 40), (uint8_t)(255 - index), (uint8_t)(index * 7), (uint8_t)200);
+	update.stroke.parse(String::fromInt(x) + "," + String::fromInt(y) + "," +
+	                    String::fromInt(x + 15) + "," + String::fromInt(y + 10));
+	return update;
+}
+
+/*
+ * Draws the updates from first up to, but not including, last, as
+ * they'd be drawn when they were posted.
+ */
+static void
+drawUpdates(Image *image, unsigned int first, unsigned int last)
+{
+	for(unsigned int i = first; i < last; ++i) {
+		PaintUpdate update = makeUpdate(i);
+		painter->processUpdate(image, update.brushSize, update.brushColor, update.stroke);
+	}
+}
+
+static void
+appendUpdates(Journal *journal, unsigned int first, unsigned int last)
+{
+	for(unsigned int i = first; i < last; ++i)
+		journal->append(makeUpdate(i));
+}
+
+static bool
+samePixels(const Image *a, const Image *b)
+{
+	vector <uint8_t> rowA(WIDTH * 4), rowB(WIDTH * 4);
+	for(unsigned int y = 0; y < HEIGHT; ++y) {
+		a->readRow(y, &rowA[0]);
+		b->readRow(y, &rowB[0]);
+		if(memcmp(&rowA[0], &rowB[0], WIDTH * a->getNumComponents()) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static off_t
+getFileSize(const string &filename)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0)
+		return -1;
+
+	return st.st_size;
+}
+
+/*
+ * Replays a journal onto a copy of the given canvas and checks that it
+ * ends up with the given updates drawn on it, and no others.
+ */
+static void
+checkReplay(const string &filename, unsigned int firstSegment, const Image *canvas,
+            unsigned int first, unsigned int last)
+{
+	TiledImage image(canvas);
+	TiledImage expected(canvas);
+	drawUpdates(&expected, first, last);
+
+	Journal journal(filename);
+	journal.open(firstSegment, &image);
+	TEST_CHECK(journal.getReplayed() == last - first);
+	TEST_CHECK(samePixels(&image, &expected));
+}
+
+/*
+ * A crash in the middle of writing a record leaves the segment with
+ * a torn record at the end, which replay stops at. Updates appended
+ * after the journal is opened again go to a segment of their own, so
+ * they aren't hidden behind the torn record.
+ */
+static void
+testTornRecord()
+{
+	TiledImage blank(WIDTH, HEIGHT, 3);
+
+	Journal *journal = new Journal("Canvas-torn.png");
+	journal->open(0, &blank);
+	journal->start();
+	appendUpdates(journal, 0, UPDATES);
+	journal->stop();
+	TEST_CHECK(journal->getFailures() == 0 && journal->getDropped() == 0);
+	delete journal;
+
+	// cut into the last record's CRC
+	off_t size = getFileSize("Canvas-torn.png.journal.0");
+	TEST_CHECK(size > 0 && truncate("Canvas-torn.png.journal.0", size - 2) == 0);
+	checkReplay("Canvas-torn.png", 0, &blank, 0, UPDATES - 1);
+
+	// the replay drew the updates before the torn one, and the
+	// torn one is posted again after the journal is reopened
+	TiledImage canvas(WIDTH, HEIGHT, 3);
+	journal = new Journal("Canvas-torn.png");
+	journal->open(0, &canvas);
+	journal->start();
+	appendUpdates(journal, UPDATES - 1, UPDATES * 2);
+	journal->stop();
+	delete journal;
+	TEST_CHECK(getFileSize("Canvas-torn.png.journal.1") > 0);
+
+	checkReplay("Canvas-torn.png", 0, &blank, 0, UPDATES * 2);
+}
+
+/*
+ * The segments before the one a saved canvas starts are deleted once
+ * it's written, and the rest replay onto that canvas.
+ */
+static void
+testCheckpoint()
+{
+	TiledImage canvas(WIDTH, HEIGHT, 3);
+
+	Journal journal("Canvas-checkpoint.png");
+	journal.open(0, &canvas);
+	journal.start();
+
+	appendUpdates(&journal, 0, UPDATES);
+	drawUpdates(&canvas, 0, UPDATES);
+	unsigned int segment = journal.startSegment();
+	Image *saved = canvas.snapshot();
+
+	appendUpdates(&journal, UPDATES, UPDATES * 2);
+	journal.stop();
+
+	TEST_CHECK(getFileSize("Canvas-checkpoint.png.journal.0") > 0);
+	journal.discardBefore(segment);
+	TEST_CHECK(getFileSize("Canvas-checkpoint.png.journal.0") == -1);
+	TEST_CHECK(getFileSize("Canvas-checkpoint.png.journal." + String::fromInt((int)segment)) > 0);
+
+	checkReplay("Canvas-checkpoint.png", segment, saved, UPDATES, UPDATES * 2);
+	delete saved;
+}
+
+/*
+ * Waits up to a few seconds for a journal's counter to reach a value.
+ */
+static bool
+waitFor(Journal *journal, unsigned long (Journal::*getter)(), unsigned long value)
+{
+	long timeout = getMilliseconds() + 5000;
+	while((journal->*getter)() < value) {
+		if(getMilliseconds() > timeout)
+			return false;
+		usleep(1000);
+	}
+
+	return true;
+}
+
+/*
+ * Writes that fail partway through a record, here because of the file
+ * size limit, cut the segment back to what was last synced and are
+ * tried again, so no torn record is left in front of the later ones.
+ */
+static void
+testFailedWrite()
+{
+	TiledImage blank(WIDTH, HEIGHT, 3);
+
+	Journal journal("Canvas-failed.png");
+	journal.open(0, &blank);
+	journal.start();
+	appendUpdates(&journal, 0, UPDATES);
+	TEST_CHECK(waitFor(&journal, &Journal::getCommits, 1));
+	unsigned long commits = journal.getCommits();
+
+	// let only part of the next record be written
+	struct rlimit limit, oldLimit;
+	signal(SIGXFSZ, SIG_IGN);
+	getrlimit(RLIMIT_FSIZE, &oldLimit);
+	limit = oldLimit;
+	limit.rlim_cur = (rlim_t)getFileSize("Canvas-failed.png.journal.0") + 4;
+	TEST_CHECK(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+	appendUpdates(&journal, UPDATES, UPDATES * 2);
+	TEST_CHECK(waitFor(&journal, &Journal::getFailures, 1));
+	TEST_CHECK(journal.getCommits() == commits);
+
+	setrlimit(RLIMIT_FSIZE, &oldLimit);
+	TEST_CHECK(waitFor(&journal, &Journal::getCommits, commits + 1));
+	journal.stop();
+	TEST_CHECK(journal.getDropped() == 0);
+
+	checkReplay("Canvas-failed.png", 0, &blank, 0, UPDATES * 2);
+}
+
+int
+main(int argc, char **argv)
+{
+	if(argc < 2) {
+		printf("usage: %s <directory holding Images>\n", argv[0]);
+		return 1;
+	}
+
+	// work in a new directory, with the brush images linked into it
+	string images = string(argv[1]) + "/Images";
+	char directory[] = "/tmp/xvipaint-journal-XXXXXX";
+	if(images[0] != '/') {
+		char cwd[4096];
+		if(getcwd(cwd, sizeof(cwd)) != NULL)
+			images = string(cwd) + "/" + images;
+	}
+	if(mkdtemp(directory) == NULL || chdir(directory) != 0 || symlink(images.c_str(), "Images") != 0) {
+		printf("couldn't set up %s\n", directory);
+		return 1;
+	}
+
+	painter = new Painter();
+	testTornRecord();
+	testCheckpoint();
+	testFailedWrite();
+	delete painter;
+
+	// clean up the journals
+	if(system((string("rm -rf ") + directory).c_str()) != 0)
+		printf("couldn't remove %s\n", directory);
+
+	return testResult();
+}
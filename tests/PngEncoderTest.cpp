@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that PNGs from PngEncoder decode, through libpng, to exactly
+ * the pixels and text of the image they were encoded from, at each
+ * compression level, with each filter and with 1 to 4 threads, both
+ * when the whole image is encoded and when only its changes are.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "Exception.h"
+#include "PngEncoder.h"
+#include "Test.h"
+#include "TiledImage.h"
+
+using namespace std;
+
+const int LEVELS[] = { 0, 1, 6, 9 };
+const unsigned int MAX_THREADS = 4;
+
+static string pngFilename;
+
+/*
+ * Fills a rectangle with a pattern that compresses somewhat, like
+ * strokes do, and marks it dirty.
+ */
+static void
+drawPattern(Image *image, unsigned int left, unsigned int top,
+            unsigned int width, unsigned int height, int seed)
+{
+	for(unsigned int y = top; y < top + height && y < image->getHeight(); ++y) {
+		for(unsigned int x = left; x < left + width && x < image->getWidth(); ++x) {
+			uint8_t v = (uint8_t)((((x / 7) * seed) + (y / 5)) & 0xff);
+			image->setPixel(x, y, Color(v, (uint8_t)(v / 2), (uint8_t)(255 - v), (uint8_t)(v | 0x80)));
+		}
+	}
+	image->markDirty(left, top, width, height);
+}
+
+static bool
+decodesTo(const string &png, const Image *image)
+{
+	FILE *fp = fopen(pngFilename.c_str(), "wb");
+	if(fp == NULL)
+		return false;
+	fwrite(png.data(), 1, png.length(), fp);
+	fclose(fp);
+
+	Image *decoded;
+	try {
+		decoded = Image::load(pngFilename);
+	} catch(Exception &ex) {
+		printf("%s\n", ex.toString().c_str());
+		return false;
+	}
+
+	bool same = (decoded->getWidth() == image->getWidth() &&
+	             decoded->getHeight() == image->getHeight() &&
+	             decoded->getNumComponents() == image->getNumComponents() &&
+	             decoded->getTextEntries() == image->getTextEntries());
+
+	unsigned int rowLength = image->getWidth() * image->getNumComponents();
+	vector <uint8_t> expected(image->getWidth() * 4), actual(image->getWidth() * 4);
+	for(unsigned int y = 0; same && y < image->getHeight(); ++y) {
+		image->readRow(y, &expected[0]);
+		decoded->readRow(y, &actual[0]);
+		same = (memcmp(&expected[0], &actual[0], rowLength) == 0);
+	}
+
+	delete decoded;
+	return same;
+}
+
+static void
+testSize(unsigned int width, unsigned int height, int colorComponents)
+{
+	for(unsigned int l = 0; l < sizeof(LEVELS) / sizeof(LEVELS[0]); ++l) {
+		for(int f = PngEncoder::FILTER_NONE; f <= PngEncoder::FILTER_ADAPTIVE; ++f) {
+			for(unsigned int threads = 1; threads <= MAX_THREADS; ++threads) {
+				TiledImage image(width, height, colorComponents);
+				drawPattern(&image, 0, 0, width, height, 3);
+				drawPattern(&image, width / 4, height / 3, width / 2, 40, 11);
+				image.setText("xvipaint-test", "value");
+
+				PngEncoder::Settings settings;
+				settings.level = LEVELS[l];
+				settings.filter = (PngEncoder::Filter)f;
+				settings.threads = threads;
+				PngEncoder encoder(settings);
+
+				Image *snapshot = image.snapshot();
+				string png;
+				encoder.encode(snapshot, png);
+				TEST_CHECK(decodesTo(png, snapshot));
+				delete snapshot;
+
+				// only the bands with changes are encoded again
+				drawPattern(&image, width / 3, height / 2, 50, 20, 77);
+				snapshot = image.snapshot();
+				encoder.encode(snapshot, png);
+				TEST_CHECK(decodesTo(png, snapshot));
+				TEST_CHECK(encoder.getBandsReused() > 0 || height <= 3 * PngEncoder::BAND_ROWS);
+				delete snapshot;
+			}
+		}
+	}
+}
+
+int
+main()
+{
+	char directory[] = "/tmp/xvipaint-png-XXXXXX";
+	if(mkdtemp(directory) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	pngFilename = string(directory) + "/test.png";
+
+	// sizes that are and aren't whole numbers of tiles
+	testSize(320, 256, 4);
+	testSize(130, 70, 3);
+	testSize(37, 300, 3);
+
+	unlink(pngFilename.c_str());
+	rmdir(directory);
+	return testResult();
+}
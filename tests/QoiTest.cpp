@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks that QOI checkpoints read back to exactly the pixels and text
+ * they were written with, that damaged ones are refused, and that a
+ * room refuses to load from a damaged checkpoint rather than starting
+ * over from an older canvas.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "Exception.h"
+#include "Room.h"
+#include "Test.h"
+
+using namespace std;
+
+static string directory;
+
+/*
+ * Fills an image with runs, small and large steps, repeats of recent
+ * colors and, given an alpha channel, changes in alpha, so every QOI
+ * operation is used.
+ */
+static void
+fillImage(Image *image)
+{
+	srand(1);
+	Color color((uint8_t)255, (uint8_t)255, (uint8_t)255, (uint8_t)255);
+	for(unsigned int y = 0; y < image->getHeight(); ++y) {
+		for(unsigned int x = 0; x < image->getWidth(); ++x) {
+			switch(rand() % 6) {
+				case 0:
+					break;
+				case 1:
+					color.r += (uint8_t)(rand() % 3 - 1);
+					color.b += (uint8_t)(rand() % 3 - 1);
+					break;
+				case 2:
+					color.g += (uint8_t)(rand() % 41 - 20);
+					color.r = color.g + (uint8_t)(rand() % 9);
+					break;
+				case 3:
+					color = Color((uint8_t)(rand() % 4 * 64), (uint8_t)0, (uint8_t)255, color.a);
+					break;
+				case 4:
+					color = Color((uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand(), color.a);
+					break;
+				default:
+					color.a = (uint8_t)rand();
+					break;
+			}
+			image->setPixel(x, y, color);
+		}
+	}
+}
+
+static bool
+samePixels(const Image *a, const Image *b)
+{
+	if(a->getWidth() != b->getWidth() || a->getHeight() != b->getHeight() ||
+	   a->getNumComponents() != b->getNumComponents())
+		return false;
+
+	for(unsigned int y = 0; y < a->getHeight(); ++y) {
+		for(unsigned int x = 0; x < a->getWidth(); ++x) {
+			Color ca = a->getPixel(x, y), cb = b->getPixel(x, y);
+			if(ca.r != cb.r || ca.g != cb.g || ca.b != cb.b ||
+			   (a->getNumComponents() == 4 && ca.a != cb.a))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+loads(const string &filename)
+{
+	try {
+		delete Image::load(filename);
+	} catch(Exception &ex) {
+		return false;
+	}
+
+	return true;
+}
+
+static void
+writeFile(const string &filename, const string &data)
+{
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if(fp == NULL)
+		return;
+	fwrite(data.data(), 1, data.length(), fp);
+	fclose(fp);
+}
+
+static void
+testRoundTrip(unsigned int width, unsigned int height, int colorComponents)
+{
+	Image image(width, height, colorComponents);
+	fillImage(&image);
+	image.setText("xvipaint-journal", "12");
+	image.setText("empty", "");
+	image.setText("binary", string("a\0b\n", 4));
+
+	string filename = directory + "/roundtrip.qoi";
+	image.save(filename);
+
+	Image *loaded = Image::load(filename);
+	TEST_CHECK(samePixels(&image, loaded));
+	TEST_CHECK(loaded->getTextEntries() == image.getTextEntries());
+	delete loaded;
+	unlink(filename.c_str());
+}
+
+static void
+testDamaged()
+{
+	Image image(100, 60, 3);
+	fillImage(&image);
+	string qoi;
+	image.encodeQoi(qoi);
+
+	string filename = directory + "/damaged.qoi";
+	writeFile(filename, qoi.substr(0, qoi.length() / 2));
+	TEST_CHECK(!loads(filename));
+
+	string header = qoi;
+	header[0] = 'x';
+	writeFile(filename, header);
+	TEST_CHECK(!loads(filename));
+
+	writeFile(filename, "");
+	TEST_CHECK(!loads(filename));
+
+	unlink(filename.c_str());
+}
+
+/*
+ * A damaged checkpoint must stop the room from loading, leaving the
+ * checkpoint alone, rather than have the room fall back to the canvas
+ * it was converted from.
+ */
+static void
+testDamagedCheckpoint()
+{
+	string pngFilename = directory + "/Canvas-damaged.png";
+	string qoiFilename = directory + "/Canvas-damaged.qoi";
+
+	Image legacy(800, 450, 3);
+	fillImage(&legacy);
+	legacy.save(pngFilename);
+	writeFile(qoiFilename, "qoif");
+
+	bool loaded = true;
+	try {
+		Room room("damaged", pngFilename, "test", PngEncoder::Settings());
+	} catch(Exception &ex) {
+		loaded = false;
+	}
+	TEST_CHECK(!loaded);
+
+	FILE *fp = fopen(qoiFilename.c_str(), "rb");
+	TEST_CHECK(fp != NULL && fgetc(fp) == 'q');
+	if(fp != NULL)
+		fclose(fp);
+
+	// with no checkpoint at all, the old canvas is read
+	unlink(qoiFilename.c_str());
+	Room *room = new Room("damaged", pngFilename, "test", PngEncoder::Settings());
+	string tag;
+	int updateId;
+	string servedFilename = directory + "/served.png";
+	writeFile(servedFilename, room->getCanvasPng(tag, &updateId).getString());
+	delete room;
+	Image *served = Image::load(servedFilename);
+	TEST_CHECK(samePixels(&legacy, served));
+	delete served;
+}
+
+int
+main()
+{
+	char name[] = "/tmp/xvipaint-qoi-XXXXXX";
+	if(mkdtemp(name) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	directory = name;
+
+	testRoundTrip(800, 450, 3);
+	testRoundTrip(37, 300, 4);
+	testRoundTrip(1, 1, 4);
+	testDamaged();
+	testDamagedCheckpoint();
+
+	if(system((string("rm -rf ") + directory).c_str()) != 0)
+		printf("couldn't remove %s\n", directory.c_str());
+
+	return testResult();
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Draws in a room from several threads while another thread evicts it
+ * whenever it's unused, so the room is written out and loaded again
+ * over and over while it's being drawn in. Every update must be on the
+ * canvas once the room is finally written out; a room loaded again
+ * while its last instance was still being written out would lose some.
+ *
+ * Run with the directory holding the brush images ("Images").
+ */
+
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <xviweb/String.h>
+#include "RoomTable.h"
+#include "Test.h"
+#include "Util.h"
+
+using namespace std;
+
+const char *ROOM_NAME = "eviction";
+const unsigned int DRAWERS = 3;
+const unsigned int UPDATES = 400;
+const unsigned int COLUMNS = 90;
+const unsigned int SPACING = 8;
+
+static RoomTable *table;
+static volatile int drawersLeft;
+
+static void
+getPosition(unsigned int index, unsigned int *x, unsigned int *y)
+{
+	*x = SPACING + (index % COLUMNS) * SPACING;
+	*y = SPACING + (index / COLUMNS) * SPACING;
+}
+
+class Drawer : public Thread
+{
+	private:
+		unsigned int m_index;
+
+	protected:
+		void
+		run()
+		{
+			Painter painter;
+
+			for(unsigned int i = 0; i < UPDATES; ++i) {
+				unsigned int x, y;
+				getPosition((m_index * UPDATES) + i, &x, &y);
+
+				PaintUpdate update;
+				update.userId = (int)m_index;
+				update.brushSize = 2;
+				update.brushColor = Color(string("#000000"));
+				update.stroke.parse(String::fromInt((int)x) + "," + String::fromInt((int)y) + "," +
+				                    String::fromInt((int)x) + "," + String::fromInt((int)y));
+
+				Room *room = table->getRoom(ROOM_NAME);
+				room->renderUpdate(update, &painter);
+				room->unpin();
+
+				// leave the room unused now and then so it's evicted
+				if(i % 4 == 0)
+					usleep(1000);
+			}
+
+			__sync_sub_and_fetch(&drawersLeft, 1);
+		}
+
+	public:
+		Drawer(unsigned int index)
+		{
+			m_index = index;
+		}
+};
+
+class Evictor : public Thread
+{
+	public:
+		unsigned int evictions;
+
+		Evictor()
+		{
+			evictions = 0;
+		}
+
+	protected:
+		void
+		run()
+		{
+			// every room is idle for longer than the idle time of zero
+			while(__sync_fetch_and_add(&drawersLeft, 0) != 0)
+				evictions += table->evictRooms(getMilliseconds() + 1);
+		}
+};
+
+int
+main(int argc, char **argv)
+{
+	if(argc < 2) {
+		printf("usage: %s <directory holding Images>\n", argv[0]);
+		return 1;
+	}
+
+	// work in a new directory, with the brush images linked into it
+	string images = string(argv[1]) + "/Images";
+	char directory[] = "/tmp/xvipaint-eviction-XXXXXX";
+	if(images[0] != '/') {
+		char cwd[4096];
+		if(getcwd(cwd, sizeof(cwd)) != NULL)
+			images = string(cwd) + "/" + images;
+	}
+	if(mkdtemp(directory) == NULL || chdir(directory) != 0 || symlink(images.c_str(), "Images") != 0) {
+		printf("couldn't set up %s\n", directory);
+		return 1;
+	}
+
+	PngEncoder::Settings settings;
+	table = new RoomTable(settings, 1, 0);
+
+	drawersLeft = DRAWERS;
+	Drawer *drawers[DRAWERS];
+	for(unsigned int i = 0; i < DRAWERS; ++i) {
+		drawers[i] = new Drawer(i);
+		drawers[i]->start();
+	}
+	Evictor evictor;
+	evictor.start();
+
+	for(unsigned int i = 0; i < DRAWERS; ++i) {
+		drawers[i]->join();
+		delete drawers[i];
+	}
+	evictor.join();
+	printf("room evicted %u times while being drawn in\n", evictor.evictions);
+	TEST_CHECK(evictor.evictions > 0);
+
+	// write the room out for the last time and check every update made it
+	delete table;
+	Image *image = Image::load(string("Canvas-") + ROOM_NAME + ".qoi");
+	unsigned int missing = 0;
+	for(unsigned int i = 0; i < DRAWERS * UPDATES; ++i) {
+		unsigned int x, y;
+		getPosition(i, &x, &y);
+
+		bool drawn = false;
+		for(unsigned int dy = 0; dy < 3; ++dy) {
+			for(unsigned int dx = 0; dx < 3; ++dx) {
+				Color color = image->getPixel(x + dx - 1, y + dy - 1);
+				drawn = drawn || color.r != 255 || color.g != 255 || color.b != 255;
+			}
+		}
+		if(!drawn)
+			++missing;
+	}
+	delete image;
+
+	if(missing != 0)
+		printf("%u of %u updates are missing from the canvas\n", missing, DRAWERS * UPDATES);
+	TEST_CHECK(missing == 0);
+
+	// clean up the room's files
+	if(system((string("rm -rf ") + directory).c_str()) != 0)
+		printf("couldn't remove %s\n", directory);
+
+	return testResult();
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Draws in a room from several poster threads while several reader
+ * threads keep asking it for updates, the way GetUpdates connections
+ * do. Every reader must get every update posted by other users exactly
+ * once and in order, and none of its own user's.
+ *
+ * Run with the directory holding the brush images ("Images").
+ */
+
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <xviweb/String.h>
+#include "Room.h"
+#include "Test.h"
+#include "Util.h"
+
+using namespace std;
+
+const unsigned int POSTERS = 4;
+const unsigned int READERS = 6;
+const unsigned int UPDATES = 500;
+
+static Room *room;
+static volatile int postersLeft;
+
+class Poster : public Thread
+{
+	private:
+		unsigned int m_index;
+
+	protected:
+		void
+		run()
+		{
+			Painter painter;
+			srand(m_index + 1);
+
+			for(unsigned int i = 0; i < UPDATES; ++i) {
+				// the poster is told apart by the color's red
+				PaintUpdate update;
+				update.userId = (int)m_index;
+				update.brushSize = 4;
+				update.brushColor = Color((uint8_t)m_index, (uint8_t)0, (uint8_t)0);
+
+				int x = rand() % 780, y = rand() % 430;
+				update.stroke.parse(String::fromInt(x) + "," + String::fromInt(y) + "," +
+				                    String::fromInt(x + 15) + "," + String::fromInt(y + 15));
+
+				room->renderUpdate(update, &painter);
+				room->publish(getMilliseconds());
+			}
+
+			__sync_sub_and_fetch(&postersLeft, 1);
+		}
+
+	public:
+		Poster(unsigned int index)
+		{
+			m_index = index;
+		}
+};
+
+class Reader : public Thread
+{
+	private:
+		int m_userId;
+		int m_lastUpdateId;
+
+		void
+		readUpdates()
+		{
+			vector <SharedBuffer> frames;
+			m_lastUpdateId = room->getUpdates(m_userId, m_lastUpdateId, false, frames);
+
+			for(size_t i = 0; i < frames.size(); ++i) {
+				const string &frame = frames[i].getString();
+				for(size_t start = 0; start < frame.length();) {
+					size_t end = frame.find('\n', start);
+					if(end == string::npos)
+						end = frame.length();
+					string line = frame.substr(start, end - start);
+					start = end + 1;
+
+					// only updates are expected, not catch-ups
+					vector <string> fields = String::split(line, " ");
+					if(fields.size() != 4 || fields[2].length() != 7 || fields[2][0] != '#') {
+						++unexpected;
+						continue;
+					}
+
+					ids.push_back(atoi(fields[0].c_str()));
+					posters.push_back((int)String::hexToUInt(fields[2], 1, 2));
+				}
+			}
+		}
+
+	protected:
+		void
+		run()
+		{
+			while(__sync_fetch_and_add(&postersLeft, 0) != 0)
+				readUpdates();
+
+			// and once more for anything published since
+			readUpdates();
+		}
+
+	public:
+		vector <int> ids;
+		vector <int> posters;
+		unsigned int unexpected;
+
+		Reader(int userId)
+		{
+			m_userId = userId;
+			m_lastUpdateId = 0;
+			unexpected = 0;
+		}
+};
+
+int
+main(int argc, char **argv)
+{
+	if(argc < 2) {
+		printf("usage: %s <directory holding Images>\n", argv[0]);
+		return 1;
+	}
+
+	// work in a new directory, with the brush images linked into it
+	string images = string(argv[1]) + "/Images";
+	char directory[] = "/tmp/xvipaint-stress-XXXXXX";
+	if(images[0] != '/') {
+		char cwd[4096];
+		if(getcwd(cwd, sizeof(cwd)) != NULL)
+			images = string(cwd) + "/" + images;
+	}
+	if(mkdtemp(directory) == NULL || chdir(directory) != 0 || symlink(images.c_str(), "Images") != 0) {
+		printf("couldn't set up %s\n", directory);
+		return 1;
+	}
+
+	room = new Room("stress", "Canvas-stress.png", "test", PngEncoder::Settings());
+
+	// readers share their user ids with the first posters, so each
+	// of those is sent everything but that poster's own updates
+	postersLeft = POSTERS;
+	Reader *readers[READERS];
+	for(unsigned int i = 0; i < READERS; ++i) {
+		readers[i] = new Reader((int)i);
+		readers[i]->start();
+	}
+	Poster *posters[POSTERS];
+	for(unsigned int i = 0; i < POSTERS; ++i) {
+		posters[i] = new Poster(i);
+		posters[i]->start();
+	}
+
+	for(unsigned int i = 0; i < POSTERS; ++i) {
+		posters[i]->join();
+		delete posters[i];
+	}
+
+	for(unsigned int i = 0; i < READERS; ++i) {
+		Reader *reader = readers[i];
+		reader->join();
+
+		// the ids of the updates the reader should have had
+		unsigned int expected = 0;
+		for(unsigned int j = 0; j < POSTERS; ++j) {
+			if(j != i)
+				expected += UPDATES;
+		}
+
+		unsigned int outOfOrder = 0, own = 0;
+		for(size_t j = 0; j < reader->ids.size(); ++j) {
+			if(j > 0 && reader->ids[j] <= reader->ids[j - 1])
+				++outOfOrder;
+			if(reader->posters[j] == (int)i)
+				++own;
+		}
+
+		printf("reader %u: %u updates, expected %u, %u out of order, %u of its own, %u unexpected lines\n",
+		       i, (unsigned int)reader->ids.size(), expected, outOfOrder, own, reader->unexpected);
+		TEST_CHECK(reader->ids.size() == expected);
+		TEST_CHECK(outOfOrder == 0);
+		TEST_CHECK(own == 0);
+		TEST_CHECK(reader->unexpected == 0);
+		delete reader;
+	}
+
+	delete room;
+
+	// clean up the room's files
+	if(system((string("rm -rf ") + directory).c_str()) != 0)
+		printf("couldn't remove %s\n", directory);
+
+	return testResult();
+}
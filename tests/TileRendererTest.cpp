@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2011 Josh A. Beam
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Draws the same random strokes on one canvas with Painter, an update
+ * at a time, and on others with TileRenderer at 1, 2, 4 and 8 threads.
+ * After each batch every canvas must have the same pixels, and the
+ * same tiles must have been marked dirty by it.
+ *
+ * Run with the directory holding the brush images ("Images").
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <xviweb/String.h>
+#include "Painter.h"
+#include "Test.h"
+#include "TileRenderer.h"
+#include "TiledImage.h"
+
+using namespace std;
+
+const unsigned int WIDTH = 800;
+const unsigned int HEIGHT = 450;
+const unsigned int THREAD_COUNTS[] = { 1, 2, 4, 8 };
+const unsigned int RENDERERS = sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]);
+const unsigned int BATCHES = 6;
+const unsigned int BATCH_SIZE = 40;
+const int BRUSH_SIZES[] = { 2, 4, 8, 16, 32 };
+
+/*
+ * Makes an update of one random polyline, sometimes a single dot, with
+ * points that can fall a little outside of the canvas.
+ */
+static PaintUpdate *
+makeUpdate()
+{
+	PaintUpdate *update = new PaintUpdate();
+	update->brushSize = BRUSH_SIZES[rand() % (sizeof(BRUSH_SIZES) / sizeof(BRUSH_SIZES[0]))];
+	update->brushColor = Color((uint8_t)(rand() % 256), (uint8_t)(rand() % 256),
+	                           (uint8_t)(rand() % 256), (uint8_t)(64 + rand() % 192));
+
+	int x = rand() % (WIDTH + 40), y = rand() % (HEIGHT + 40);
+	unsigned int segments = (rand() % 4 == 0) ? 1 : 1 + rand() % 12;
+	bool dot = (segments == 1 && rand() % 2 == 0);
+
+	string line;
+	for(unsigned int i = 0; i < segments; ++i) {
+		int nextX = dot ? x : abs(x + (rand() % 161) - 80);
+		int nextY = dot ? y : abs(y + (rand() % 161) - 80);
+		if(!line.empty())
+			line += ';';
+		line += String::fromInt(x) + "," + String::fromInt(y) + "," +
+		        String::fromInt(nextX) + "," + String::fromInt(nextY);
+		x = nextX;
+		y = nextY;
+	}
+
+	update->stroke.parse(line);
+	return update;
+}
+
+static bool
+samePixels(const Image *a, const Image *b)
+{
+	vector <uint8_t> rowA(WIDTH * 4), rowB(WIDTH * 4);
+	for(unsigned int y = 0; y < HEIGHT; ++y) {
+		a->readRow(y, &rowA[0]);
+		b->readRow(y, &rowB[0]);
+		if(memcmp(&rowA[0], &rowB[0], WIDTH * a->getNumComponents()) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Checks that the same tiles of both images are dirty since the given
+ * serials, which were taken from each image before the batch.
+ */
+static bool
+sameDirtyTiles(const Image *a, unsigned int serialA, const Image *b, unsigned int serialB)
+{
+	for(unsigned int row = 0; row < a->getTileRows(); ++row) {
+		for(unsigned int column = 0; column < a->getTileColumns(); ++column) {
+			if(a->isTileDirty(column, row, serialA) != b->isTileDirty(column, row, serialB))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	if(argc != 2) {
+		fprintf(stderr, "usage: %s <directory holding Images>\n", argv[0]);
+		return 1;
+	}
+	if(chdir(argv[1]) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	srand(1);
+	Painter painter;
+	TiledImage expected(WIDTH, HEIGHT, 3);
+	unsigned int expectedStart = expected.getModificationSerial();
+
+	vector <TileRenderer *> renderers;
+	vector <TiledImage *> images;
+	vector <unsigned int> starts;
+	for(unsigned int i = 0; i < RENDERERS; ++i) {
+		renderers.push_back(new TileRenderer(THREAD_COUNTS[i]));
+		images.push_back(new TiledImage(WIDTH, HEIGHT, 3));
+		starts.push_back(images[i]->getModificationSerial());
+	}
+
+	for(unsigned int batch = 0; batch < BATCHES; ++batch) {
+		vector <PaintUpdate *> updates;
+		for(unsigned int i = 0; i < BATCH_SIZE; ++i)
+			updates.push_back(makeUpdate());
+
+		unsigned int expectedSerial = expected.getModificationSerial();
+		for(unsigned int i = 0; i < updates.size(); ++i)
+			painter.processUpdate(&expected, updates[i]->brushSize, updates[i]->brushColor, updates[i]->stroke);
+
+		for(unsigned int i = 0; i < RENDERERS; ++i) {
+			unsigned int serial = images[i]->getModificationSerial();
+			renderers[i]->render(images[i], updates);
+
+			TEST_CHECK(samePixels(&expected, images[i]));
+			TEST_CHECK(sameDirtyTiles(&expected, expectedSerial, images[i], serial));
+		}
+
+		for(unsigned int i = 0; i < updates.size(); ++i)
+			delete updates[i];
+	}
+
+	// and the tiles dirtied over all of the batches
+	for(unsigned int i = 0; i < RENDERERS; ++i) {
+		TEST_CHECK(sameDirtyTiles(&expected, expectedStart, images[i], starts[i]));
+		delete images[i];
+		delete renderers[i];
+	}
+
+	return testResult();
+}
@@ -25,39 +25,181 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 	var m_mouseX = 0;
 	var m_mouseY = 0;
 
-	var m_lineData = "";
+	// lines waiting to be posted, as polylines of x, y pairs
+	var m_polylines = [];
 
 	var m_request = null;
 	var m_parseUpdatesInterval = null;
 	var m_postUpdateInterval = null;
 	var m_lastUpdateId = updateId;
 
+	// received lines not yet handled, and how much of the response
+	// they've been taken from; handling waits while a catch-up image
+	// is loading, so that later updates are drawn on top of it
+	var m_pendingLines = [];
+	var m_responseOffset = 0;
+	var m_loadingImage = false;
+
+	// which load of the room on the server the update ids are from
+	var m_epoch = null;
+
+	// the pixels the server has sent as images, without any strokes
+	// drawn here, and the epoch and update they're as of; a catch-up
+	// only brings them up to date if it's of the whole canvas or is
+	// known to be from that update, which a connection's catch-up no
+	// longer is once updates have been received or posted on it
+	var m_serverCanvas = null;
+	var m_serverContext = null;
+	var m_serverEpoch = null;
+	var m_serverUpdateId = 0;
+	var m_catchUpFromId = 0;
+	var m_catchUpWhole = false;
+
 	var m_brushSize = 4;
 	var m_brushColor = "#000000";
 
+	// the board to draw on, given by the page's "r" parameter
+	var m_room = getRoom();
+
 	function construct()
 	{
 		// just return if there's no canvas support in the browser
 		if(m_context == null)
 			return;
 
+		m_serverCanvas = document.createElement("canvas");
+		m_serverCanvas.width = m_canvas.width;
+		m_serverCanvas.height = m_canvas.height;
+		m_serverContext = m_serverCanvas.getContext("2d");
+
 		// make the controls visible
 		if(m_controls != null)
 			m_controls.style.display = "block";
 
 		m_canvas.onmousedown = mouseDown;
 		m_canvas.onmousemove = mouseMove;
+		window.addEventListener("pagehide", saveCanvas);
+
+		if(!loadSavedCanvas())
+			loadCanvas();
+	}
+
+	function getRoom()
+	{
+		var match = /[?&]r=([A-Za-z0-9_-]+)/.exec(window.location.search);
+		return (match == null) ? "" : match[1];
+	}
+
+	function loadCanvas()
+	{
+		// the canvas comes with the id of the last update drawn on
+		// it, so updates it already contains aren't received again
+		var request = new XMLHttpRequest();
+		request.open("GET", "PaintAction/GetCanvas?r=" + m_room, true);
+		request.responseType = "blob";
+		request.onload = function() {
+			if(request.status != 200)
+				return;
+
+			var updateId = parseInt(request.getResponseHeader("X-Update-Id"));
+			if(!isNaN(updateId))
+				m_lastUpdateId = updateId;
+			m_epoch = request.getResponseHeader("X-Canvas-Epoch");
+
+			var url = window.URL.createObjectURL(request.response);
+			var image = new Image();
+			image.onload = function() {
+				// show image on canvas
+				m_context.drawImage(image, 0, 0);
+				m_serverContext.drawImage(image, 0, 0);
+				m_serverEpoch = m_epoch;
+				m_serverUpdateId = m_lastUpdateId;
+				window.URL.revokeObjectURL(url);
+
+				// open a connection to receive updates
+				setTimeout(openConnection, 500);
+			}
+			image.src = url;
+		}
+		request.send(null);
+	}
+
+	function getSavedCanvasKey()
+	{
+		return "xvipaint-canvas:" + m_room;
+	}
+
+	/*
+	 * Draws the copy of the canvas saved by the last visit and fetches
+	 * just the tiles that have changed since, if there's a copy.
+	 */
+	function loadSavedCanvas()
+	{
+		var saved = null;
+		try {
+			saved = JSON.parse(window.localStorage.getItem(getSavedCanvasKey()));
+		} catch(e) {
+		}
+		if(saved == null || saved.epoch == null || saved.image == null)
+			return false;
 
 		var image = new Image();
 		image.onload = function() {
-			// show image on canvas
 			m_context.drawImage(image, 0, 0);
+			m_serverContext.drawImage(image, 0, 0);
+			m_serverEpoch = saved.epoch;
+			m_serverUpdateId = saved.updateId;
+			m_catchUpFromId = saved.updateId;
+
+			var request = new XMLHttpRequest();
+			request.open("GET", "PaintAction/Tiles?r=" + m_room + "&e=" +
+			             encodeURIComponent(saved.epoch) + "&v=" + saved.updateId, true);
+			request.onload = function() {
+				if(request.status != 200) {
+					loadCanvas();
+					return;
+				}
+
+				// the tiles are drawn before any update received later
+				m_lastUpdateId = parseInt(request.getResponseHeader("X-Update-Id"));
+				m_epoch = request.getResponseHeader("X-Canvas-Epoch");
+				var lines = request.responseText.split('\n');
+				for(var i = 0; i < lines.length; ++i)
+					m_pendingLines.push(lines[i]);
+				handleLines();
+
+				setTimeout(openConnection, 500);
+			}
+			request.onerror = loadCanvas;
+			request.send(null);
+		}
+		image.onerror = loadCanvas;
+		image.src = saved.image;
 
-			// open a connection to receive updates
-			setTimeout(openConnection, 500);
+		return true;
+	}
+
+	/*
+	 * Saves a copy of the canvas along with the update it's as of, so
+	 * that the next visit only needs the tiles changed since. Only the
+	 * images the server sent are saved; strokes drawn here, including
+	 * this user's own, which aren't sent back, come with the tiles.
+	 */
+	function saveCanvas()
+	{
+		if(m_serverEpoch == null)
+			return;
+
+		var saved = {
+			epoch: m_serverEpoch,
+			updateId: m_serverUpdateId,
+			image: m_serverCanvas.toDataURL("image/png")
+		};
+		try {
+			window.localStorage.setItem(getSavedCanvasKey(), JSON.stringify(saved));
+		} catch(e) {
+			// storage is full or disabled
 		}
-		var d = new Date();
-		image.src = "Canvas.png?t=" + d.getTime();
 	}
 
 	function getMouseX(e)
@@ -117,6 +259,143 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 		m_mouseY = y;
 	}
 
+	function appendVarint(bytes, value)
+	{
+		while(value >= 0x80) {
+			bytes.push((value & 0x7f) | 0x80);
+			value >>>= 7;
+		}
+		bytes.push(value);
+	}
+
+	function appendSignedVarint(bytes, value)
+	{
+		appendVarint(bytes, ((value << 1) ^ (value >> 31)) >>> 0);
+	}
+
+	function readVarint(reader)
+	{
+		var value = 0;
+		for(var shift = 0; shift < 35; shift += 7) {
+			if(reader.pos >= reader.bytes.length)
+				return null;
+
+			var c = reader.bytes.charCodeAt(reader.pos++);
+			value += (c & 0x7f) * Math.pow(2, shift);
+			if((c & 0x80) == 0)
+				return value;
+		}
+
+		return null;
+	}
+
+	function readSignedVarint(reader)
+	{
+		var value = readVarint(reader);
+		if(value == null)
+			return null;
+
+		return (value % 2 == 0) ? (value / 2) : -((value + 1) / 2);
+	}
+
+	function readUInt32(reader)
+	{
+		if(reader.pos + 4 > reader.bytes.length)
+			return null;
+
+		var value = 0;
+		for(var i = 0; i < 4; ++i)
+			value = (value * 256) + reader.bytes.charCodeAt(reader.pos++);
+		return value;
+	}
+
+	function encodeBase64(bytes)
+	{
+		// binary data is sent as url-safe base64 without padding
+		var s = "";
+		for(var i = 0; i < bytes.length; ++i)
+			s += String.fromCharCode(bytes[i]);
+		return btoa(s).replace(/\+/g, "-").replace(/\//g, "_").replace(/=+$/, "");
+	}
+
+	function decodeBase64(s)
+	{
+		s = s.replace(/-/g, "+").replace(/_/g, "/");
+		while(s.length % 4 != 0)
+			s += "=";
+		return atob(s);
+	}
+
+	/*
+	 * Encodes an update in binary: the brush size, the brush color
+	 * as RGBA, the user id and then each polyline as its point count
+	 * followed by zig-zag deltas from the point before.
+	 */
+	function encodeUpdate(size, color, polylines)
+	{
+		var bytes = [];
+		appendVarint(bytes, size);
+
+		var rgba = ((parseInt(color.substring(1), 16) << 8) | 0xff) >>> 0;
+		bytes.push(rgba >>> 24, (rgba >>> 16) & 0xff, (rgba >>> 8) & 0xff, rgba & 0xff);
+
+		appendVarint(bytes, userId);
+
+		var x = 0, y = 0;
+		for(var i = 0; i < polylines.length; ++i) {
+			var p = polylines[i];
+			appendVarint(bytes, p.length / 2);
+			for(var j = 0; j < p.length; j += 2) {
+				appendSignedVarint(bytes, p[j] - x);
+				appendSignedVarint(bytes, p[j + 1] - y);
+				x = p[j];
+				y = p[j + 1];
+			}
+		}
+
+		return encodeBase64(bytes);
+	}
+
+	function parseBinaryUpdate(update)
+	{
+		var reader = { bytes: decodeBase64(update), pos: 0 };
+
+		// if the update id is greater than the last
+		// update id, continue parsing the update
+		var thisUpdateId = readVarint(reader);
+		if(thisUpdateId == null || thisUpdateId <= m_lastUpdateId)
+			return;
+		m_lastUpdateId = thisUpdateId;
+		m_catchUpFromId = null;
+
+		var size = readVarint(reader);
+		var rgba = readUInt32(reader);
+		if(size == null || rgba == null || readVarint(reader) == null)
+			return;
+		var color = "rgba(" + (rgba >>> 24) + "," + ((rgba >>> 16) & 0xff) + "," +
+		            ((rgba >>> 8) & 0xff) + "," + ((rgba & 0xff) / 255) + ")";
+
+		// draw each polyline; a single point is a dot
+		var x = 0, y = 0;
+		while(reader.pos < reader.bytes.length) {
+			var count = readVarint(reader);
+			if(count == null)
+				return;
+
+			for(var i = 0; i < count; ++i) {
+				var dx = readSignedVarint(reader);
+				var dy = readSignedVarint(reader);
+				if(dx == null || dy == null)
+					return;
+
+				if(i != 0 || count == 1)
+					drawLine(size, color, x, y, x + dx, y + dy);
+				x += dx;
+				y += dy;
+			}
+		}
+	}
+
 	function parseLines(size, color, lines)
 	{
 		var l = lines.split(';');
@@ -142,27 +421,87 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 			if(thisUpdateId > m_lastUpdateId) {
 				parseLines(u[1], u[2], u[3]);
 				m_lastUpdateId = thisUpdateId;
+				m_catchUpFromId = null;
 			}
 		}
 	}
 
-	function parseUpdates()
+	/*
+	 * Draws a catch-up image, the whole canvas or a single tile of it,
+	 * from url-safe base64 PNG data.
+	 */
+	function drawCatchUpImage(x, y, data)
 	{
-		if(!m_request)
-			return;
+		var image = new Image();
+		image.onload = function() {
+			m_context.clearRect(x, y, image.width, image.height);
+			m_context.drawImage(image, x, y);
+			m_serverContext.clearRect(x, y, image.width, image.height);
+			m_serverContext.drawImage(image, x, y);
+			m_loadingImage = false;
+			handleLines();
+		}
+		image.onerror = function() {
+			m_loadingImage = false;
+			handleLines();
+		}
+
+		m_loadingImage = true;
+		image.src = "data:image/png;base64," + btoa(decodeBase64(data));
+	}
 
-		var updates = m_request.responseText.split('\n');
-		for(var i = 0; i < updates.length; ++i) {
-			if(updates[i].indexOf("hi:") == 0) {
+	function handleLines()
+	{
+		while(m_pendingLines.length != 0 && !m_loadingImage) {
+			var line = m_pendingLines.shift();
+			if(line.indexOf("hi:") == 0) {
 				// do nothing
-			} else if(updates[i].indexOf("uo:") == 0) {
-				m_usersOnline.innerHTML = "Users Online: " + parseInt(updates[i].substring(3));
+			} else if(line.indexOf("uo:") == 0) {
+				m_usersOnline.innerHTML = "Users Online: " + parseInt(line.substring(3));
+			} else if(line.indexOf("b:") == 0) {
+				parseBinaryUpdate(line.substring(2));
+			} else if(line.indexOf("ct:") == 0) {
+				// a tile changed by updates that are no longer sent
+				var end = line.indexOf(":", 3);
+				var coords = line.substring(3, end).split(",");
+				drawCatchUpImage(parseInt(coords[0]), parseInt(coords[1]), line.substring(end + 1));
+			} else if(line.indexOf("cs:") == 0) {
+				m_catchUpWhole = true;
+				drawCatchUpImage(0, 0, line.substring(3));
+			} else if(line.indexOf("ci:") == 0) {
+				// the canvas is now as of this update, which may be
+				// older than the last one seen if the server restarted
+				m_lastUpdateId = parseInt(line.substring(3));
+				if(m_catchUpWhole || m_catchUpFromId == m_serverUpdateId) {
+					m_serverEpoch = m_epoch;
+					m_serverUpdateId = m_lastUpdateId;
+				}
+				m_catchUpWhole = false;
 			} else {
-				parseUpdate(updates[i]);
+				parseUpdate(line);
 			}
 		}
 	}
 
+	function parseUpdates()
+	{
+		if(!m_request)
+			return;
+
+		// take the complete lines received since the last call
+		var text = m_request.responseText;
+		var end = text.lastIndexOf('\n');
+		if(end < m_responseOffset)
+			return;
+
+		var lines = text.substring(m_responseOffset, end).split('\n');
+		m_responseOffset = end + 1;
+		for(var i = 0; i < lines.length; ++i)
+			m_pendingLines.push(lines[i]);
+
+		handleLines();
+	}
+
 	function connectionStateChanged()
 	{
 		if(!m_request || m_request.readyState < 2)
@@ -174,6 +513,12 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 			return;
 		}
 
+		// a canvas from another epoch is replaced by the server, and
+		// the ids that follow are from the epoch it gives
+		var epoch = m_request.getResponseHeader("X-Canvas-Epoch");
+		if(epoch != null)
+			m_epoch = epoch;
+
 		// re-open the connection if it's closed
 		if(m_request.readyState == 4) {
 			closeConnection();
@@ -188,10 +533,17 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 			return;
 
 		var src = "PaintAction/GetUpdates";
-		src += "?u=" + userId;
+		src += "?r=" + m_room;
+		src += "&u=" + userId;
 		src += "&i=" + m_lastUpdateId;
+		src += "&e=" + encodeURIComponent(m_epoch);
+		src += "&f=b";
+
+		// a catch-up at the start of the connection is from this update
+		m_catchUpFromId = m_lastUpdateId;
 
 		// create request
+		m_responseOffset = 0;
 		m_request = new XMLHttpRequest();
 		m_request.open("GET", src, true);
 		m_request.onreadystatechange = connectionStateChanged;
@@ -228,30 +580,31 @@ function PaintCanvas(userId, updateId, canvasId, controlsId, usersOnlineId)
 	function postUpdate()
 	{
 		// just return if there's no data to be posted
-		if(m_lineData.length == 0)
+		if(m_polylines.length == 0)
 			return;
 
 		// create request
 		var request = new XMLHttpRequest();
-		request.open("POST", "PaintAction/PostUpdate", true);
+		request.open("POST", "PaintAction/PostUpdate?r=" + m_room, true);
 
-		var data = "?u=" + userId;
-		data += "&s=" + m_brushSize;
-		data += "&c=" + m_brushColor;
-		data += "&l=" + m_lineData;
+		var data = "b=" + encodeUpdate(m_brushSize, m_brushColor, m_polylines);
 
 		// send data
 		request.setRequestHeader("Content-Type", "application/x-www-form-urlencoded");
 		request.send(data);
-		m_lineData = "";
+		m_polylines = [];
+		m_catchUpFromId = null;
 	}
 
 	function queueLineData(x1, y1, x2, y2)
 	{
-		// add line data to queue
-		if(m_lineData.length != 0)
-			m_lineData += ";";
-		m_lineData += x1 + "," + y1 + "," + x2 + "," + y2;
+		// add line data to queue, continuing the last
+		// polyline if the line starts where it ended
+		var p = m_polylines[m_polylines.length - 1];
+		if(p && p[p.length - 2] == x1 && p[p.length - 1] == y1)
+			p.push(x2, y2);
+		else
+			m_polylines.push([x1, y1, x2, y2]);
 	}
 
 	function drawPoint(size, x, y)